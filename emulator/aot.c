@@ -0,0 +1,74 @@
+#include "aot.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "config.h"
+
+void attachAot(chip8* chip, const aotProgram* program) {
+    aotDestroy(chip->aot);
+    chip->aot = calloc(1, sizeof(aotState));
+    if (chip->aot == NULL) {
+        return;
+    }
+    chip->aot->program = program;
+    for (int start = 0; start < 0x1000; start++) {
+        if (program->blocks[start]) {
+            memset(chip->aot->covered + start, 1, program->ends[start] - start);
+        }
+    }
+}
+
+// Blocks are compiled from the ROM image; once a byte under one changes it falls back to the interpreter
+void aotInvalidate(aotState* aot, word address) {
+    if (!aot->covered[address]) {
+        return;
+    }
+    aot->covered[address] = 0;
+    for (int start = address; start >= 0 && address - start < AOT_MAX_BLOCK * 2; start--) {
+        if (aot->program->blocks[start] && aot->program->ends[start] > address) {
+            aot->stale[start] = 1;
+        }
+    }
+}
+
+chip8stop runAot(chip8* chip, int budget) {
+    aotState* aot = chip->aot;
+    if (aot == NULL) {
+        return runInterpreter(chip, budget);
+    }
+    if (aot->program->quirks != chip->quirks) {
+        if (!aot->warned) {
+            fprintf(stderr, "AOT blocks were compiled for quirks %X but the chip runs %X, interpreting instead\n", aot->program->quirks, chip->quirks);
+            aot->warned = 1;
+        }
+        return runInterpreter(chip, budget);
+    }
+    const aotProgram* program = aot->program;
+
+    int count = budget;
+    while (count > 0) {
+        word address = chip->PC & chip->memoryMask;
+        if (address < 0x1000 && program->blocks[address] && !aot->stale[address] && program->lengths[address] <= count) {
+            chip->PC = address;
+            count -= program->lengths[address];
+            chip->instructions += program->lengths[address];
+            chip8stop stop = program->blocks[address](chip);
+            if (stop != STOP_NONE) {
+                return stop;
+            }
+        } else {
+            count--;
+            chip8stop stop = runInterpreter(chip, 1);
+            if (stop != STOP_BUDGET) {
+                return stop;
+            }
+        }
+    }
+    return STOP_BUDGET;
+}
+
+void aotDestroy(aotState* aot) {
+    free(aot);
+}
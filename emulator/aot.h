@@ -0,0 +1,30 @@
+#ifndef AOT_H
+#define AOT_H
+#include "chip8.h"
+
+// Recompiled basic block: runs every instruction of the block and leaves PC at its successor
+typedef chip8stop (*aotBlock)(chip8* chip);
+
+// Output of the recompiler: the ROM it was built from and one block per reachable entry address
+typedef struct aotProgram {
+    const byte* rom;
+    word size;
+    byte quirks;
+    aotBlock blocks[0x1000];
+    byte lengths[0x1000];
+    word ends[0x1000];
+} aotProgram;
+
+typedef struct aotState {
+    const aotProgram* program;
+    byte stale[0x1000];
+    byte covered[0x1000];
+    byte warned;
+} aotState;
+
+void attachAot(chip8* chip, const aotProgram* program);
+chip8stop runAot(chip8* chip, int budget);
+void aotInvalidate(aotState* aot, word address);
+void aotDestroy(aotState* aot);
+
+#endif
@@ -0,0 +1,61 @@
+// Check: the blocks recompiled from roms/aotcheck.ch8 at build time run the ROM exactly like the
+// switch core. The ROM calls, returns, jumps, skips, draws random digits, converts to BCD and loads
+// registers from memory, so most of what recompiler.c emits is linked and run here.
+//
+// usage: aotcheck [chunks]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "aot.h"
+#include "chip8.h"
+
+extern const aotProgram AOT_PROGRAM;
+
+static chip8* startChip(chip8core core) {
+    chip8* chip = createChip();
+    writeROM(chip, AOT_PROGRAM.rom, AOT_PROGRAM.size);
+    setQuirks(chip, AOT_PROGRAM.quirks);
+    setCore(chip, core);
+    return chip;
+}
+
+static int sameMachine(const chip8* a, const chip8* b) {
+    return memcmp(a->screen, b->screen, sizeof(a->screen)) == 0 && memcmp(a->V, b->V, sizeof(a->V)) == 0 &&
+           memcmp(a->stack, b->stack, sizeof(a->stack)) == 0 && memcmp(a->memory, b->memory, 0x1000) == 0 &&
+           a->I == b->I && a->PC == b->PC && a->SP == b->SP && a->DT == b->DT && a->rng == b->rng &&
+           a->instructions == b->instructions;
+}
+
+int main(int argc, char* argv[]) {
+    int chunks = argc > 1 ? atoi(argv[1]) : 2000;
+    if (AOT_PROGRAM.blocks[0x200] == NULL) {
+        printf("no block recompiled at 200\n");
+        return EXIT_FAILURE;
+    }
+    chip8* aot = startChip(CORE_AOT);
+    attachAot(aot, &AOT_PROGRAM);
+    chip8* interpreted = startChip(CORE_SWITCH);
+
+    int mismatch = -1;
+    for (int chunk = 0; chunk < chunks && mismatch < 0; chunk++) {
+        // Uneven budgets so that blocks are cut short by the budget at different points
+        int budget = 1 + chunk % 97;
+        chip8stop a = runCycles(aot, budget);
+        chip8stop b = runCycles(interpreted, budget);
+        if (a != b || !sameMachine(aot, interpreted)) {
+            mismatch = chunk;
+        }
+        updateTimers(aot);
+        updateTimers(interpreted);
+    }
+    printf("aot: %s after %llu instructions", mismatch < 0 ? "identical" : "diverged", aot->instructions);
+    if (mismatch >= 0) {
+        printf(" in chunk %d, PC %03X against %03X", mismatch, aot->PC, interpreted->PC);
+    }
+    printf("\n");
+    destroyChip(aot);
+    destroyChip(interpreted);
+    return mismatch < 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -4,33 +4,233 @@
 
 #include "utils.h"
 #include "config.h"
+#include "jit.h"
+#include "aot.h"
+#include "trace.h"
+#include "chip8ops.h"
 #include <stdlib.h>
 #include <string.h>
 
 chip8* createChip() {
-    chip8* chip = malloc(sizeof(chip8));
+    chip8* chip = calloc(1, sizeof(chip8));
     resetChip(chip);
     return chip;
 }
 
+void destroyChip(chip8* chip) {
+    stopTrace(chip);
+    jitDestroy(chip->jit);
+    aotDestroy(chip->aot);
+    free(chip);
+}
+
 void resetChip(chip8 *chip) {
+    jitDestroy(chip->jit);
+    aotDestroy(chip->aot);
+    // A running trace keeps recording across the reset
+    traceBuffer* trace = chip->trace;
     memset(chip, 0, sizeof(chip8));
+    chip->trace = trace;
     memcpy(&chip->memory, &INTERPRETER_DIGITS_STUB, 80);
+    memcpy(&chip->memory[BIG_DIGITS_ADDRESS], &BIG_DIGITS, sizeof(BIG_DIGITS));
     chip->PC = 0x200;
     chip->SP = 0;
+    chip->planes = 0x1;
+    chip->memoryMask = 0x0FFF;
+    setQuirks(chip, DEFAULT_QUIRKS);
+    seedChip(chip, DEFAULT_SEED);
 }
 
+static void clearPlanes(chip8* chip, byte planes) {
+#ifdef CHIP8_PACKED_SCREEN
+    for (byte p = 0; p < SCREEN_PLANES; p++) {
+        if (planes & (1 << p)) {
+            memset(chip->screen[p], 0, sizeof(chip->screen[p]));
+        }
+    }
+#else
+    if (planes == (1 << SCREEN_PLANES) - 1) {
+        memset(chip->screen, 0, sizeof(chip->screen));
+    } else {
+        byte* pixels = &chip->screen[0][0];
+        for (int i = 0; i < HIRES_X * HIRES_Y; i++) {
+            pixels[i] &= ~planes;
+        }
+    }
+#endif
+    markScreenDirty(chip);
+}
+
+// 00E0 clears only the planes selected with Fn01
 void clearDisplay(chip8 *chip) {
-    memset(chip->screen, 0, sizeof(chip->screen));
+    clearPlanes(chip, chip->planes);
+}
+
+// Forces the frontend to redraw everything, e.g. after its window was exposed
+void markScreenDirty(chip8* chip) {
+    chip->screenGeneration++;
+    chip->dirtyRows = ~(uint64_t)0 >> (64 - HIRES_Y);
+}
+
+// 00FE and 00FF: switching resolution clears every plane
+void setHires(chip8* chip, byte hires) {
+    chip->hires = hires;
+    clearPlanes(chip, (1 << SCREEN_PLANES) - 1);
 }
 
-void writeROM(chip8* chip, byte* rom, word size) {
+// Scrolling moves whole rows (or whole row words) of the selected planes at once, never single
+// pixels. The byte screen moves every plane together when all planes in use are selected.
+#ifdef CHIP8_PACKED_SCREEN
+static void scrollRows(chip8* chip, int rows) {
+    byte height = screenHeight(chip);
+    for (byte p = 0; p < SCREEN_PLANES; p++) {
+        if (!(chip->planes & (1 << p))) {
+            continue;
+        }
+        screenRow* plane = chip->screen[p];
+        if (rows > 0) {
+            memmove(&plane[rows], &plane[0], (height - rows) * sizeof(screenRow));
+            memset(&plane[0], 0, rows * sizeof(screenRow));
+        } else {
+            memmove(&plane[0], &plane[-rows], (height + rows) * sizeof(screenRow));
+            memset(&plane[height + rows], 0, -rows * sizeof(screenRow));
+        }
+    }
+    markScreenDirty(chip);
+}
+
+static void scrollColumns(chip8* chip, int columns) {
+    byte height = screenHeight(chip);
+    screenRow visible = ~(screenRow)0 << (HIRES_X - screenWidth(chip));
+    for (byte p = 0; p < SCREEN_PLANES; p++) {
+        if (!(chip->planes & (1 << p))) {
+            continue;
+        }
+        for (int y = 0; y < height; y++) {
+            screenRow* row = &chip->screen[p][y];
+            *row = columns > 0 ? (*row >> columns) & visible : *row << -columns;
+        }
+    }
+    markScreenDirty(chip);
+}
+#else
+// Whether the selected planes cover every bit set anywhere on the screen
+static byte allPlanesSelected(chip8* chip) {
+    if (chip->planes == (1 << SCREEN_PLANES) - 1) {
+        return 1;
+    }
+    byte used = 0;
+    const byte* pixels = &chip->screen[0][0];
+    for (int i = 0; i < HIRES_X * HIRES_Y; i++) {
+        used |= pixels[i];
+    }
+    return (used & ~chip->planes) == 0;
+}
+
+// Copies the selected planes' bits of pixel from into pixel to, leaving its other planes alone
+static inline void movePlaneBits(byte* to, const byte* from, byte planes) {
+    *to = (*to & ~planes) | (*from & planes);
+}
+
+static void scrollRows(chip8* chip, int rows) {
+    byte height = screenHeight(chip);
+    byte width = screenWidth(chip);
+    if (allPlanesSelected(chip)) {
+        if (rows > 0) {
+            memmove(&chip->screen[rows], &chip->screen[0], (height - rows) * sizeof(chip->screen[0]));
+            memset(&chip->screen[0], 0, rows * sizeof(chip->screen[0]));
+        } else {
+            memmove(&chip->screen[0], &chip->screen[-rows], (height + rows) * sizeof(chip->screen[0]));
+            memset(&chip->screen[height + rows], 0, -rows * sizeof(chip->screen[0]));
+        }
+    } else {
+        byte planes = chip->planes;
+        for (int i = 0; i < height; i++) {
+            int y = rows > 0 ? height - 1 - i : i;
+            int source = y - rows;
+            for (int x = 0; x < width; x++) {
+                if (source >= 0 && source < height) {
+                    movePlaneBits(&chip->screen[y][x], &chip->screen[source][x], planes);
+                } else {
+                    chip->screen[y][x] &= ~planes;
+                }
+            }
+        }
+    }
+    markScreenDirty(chip);
+}
+
+static void scrollColumns(chip8* chip, int columns) {
+    byte height = screenHeight(chip);
+    byte width = screenWidth(chip);
+    byte all = allPlanesSelected(chip);
+    byte planes = chip->planes;
+    for (int y = 0; y < height; y++) {
+        byte* row = chip->screen[y];
+        if (all && columns > 0) {
+            memmove(&row[columns], &row[0], width - columns);
+            memset(&row[0], 0, columns);
+        } else if (all) {
+            memmove(&row[0], &row[-columns], width + columns);
+            memset(&row[width + columns], 0, -columns);
+        } else {
+            for (int i = 0; i < width; i++) {
+                int x = columns > 0 ? width - 1 - i : i;
+                int source = x - columns;
+                if (source >= 0 && source < width) {
+                    movePlaneBits(&row[x], &row[source], planes);
+                } else {
+                    row[x] &= ~planes;
+                }
+            }
+        }
+    }
+    markScreenDirty(chip);
+}
+#endif
+
+void scrollDown(chip8* chip, byte rows) {
+    byte height = screenHeight(chip);
+    scrollRows(chip, rows > height ? height : rows);
+}
+
+// 00Dn, XO-CHIP
+void scrollUp(chip8* chip, byte rows) {
+    byte height = screenHeight(chip);
+    scrollRows(chip, -(rows > height ? height : rows));
+}
+
+void scrollRight(chip8* chip) {
+    scrollColumns(chip, 4);
+}
+
+void scrollLeft(chip8* chip) {
+    scrollColumns(chip, -4);
+}
+
+uint64_t takeDirtyRows(chip8* chip) {
+    uint64_t rows = chip->dirtyRows;
+    chip->dirtyRows = 0;
+    return rows;
+}
+
+// Programs past 0xE00 bytes only fit the XO-CHIP address space
+void writeROM(chip8* chip, const byte* rom, word size) {
+    if (size > 0xE00) {
+        setExtendedMemory(chip, 1);
+    }
     memcpy((byte*)(chip->memory) + chip->PC, rom, size);
+    memset(chip->cache, 0, sizeof(chip->cache));
+    if (chip->jit) {
+        jitFlush(chip->jit);
+    }
+    aotDestroy(chip->aot);
+    chip->aot = NULL;
 }
 
 byte readByte(chip8* chip) {
     byte b = chip->memory[chip->PC];
-    chip->PC = (chip->PC + 1) & 0x0FFF;
+    chip->PC = (chip->PC + 1) & chip->memoryMask;
     return b;
 }
 
@@ -40,243 +240,318 @@ word readWord(chip8* chip) {
     return parseWord(b1, b2);
 }
 
-chip8result executeInstruction(chip8 *chip) {
-    word instruction = readWord(chip);
+void decodeInstruction(chip8* chip, word address, decoded* entry) {
+    word instruction = parseWord(readMemory(chip, address), readMemory(chip, address + 1));
     byte n = getNibble(instruction);
     byte nn = getByte(instruction);
-    word nnn = getAddress(instruction);
-    byte x = getX(instruction);
-    byte y = getY(instruction);
 
-    byte buffer = 0;
-
-    if (LOGGING) {
-        printf("Address: %03X\nInstruction: %04X\nRegisters: ", chip->PC - 2, instruction);
-        for(int i = 0; i < 0x10; i ++) {
-            printf("%02X ", chip->V[i]);
-        }
-        printf("\n\n\n");
-    }
+    entry->n = n;
+    entry->nn = nn;
+    entry->nnn = getAddress(instruction);
+    entry->x = getX(instruction);
+    entry->y = getY(instruction);
+    entry->op = OP_UNKNOWN;
 
     switch(instruction >> 12) {
         case 0x0:
-            if(instruction == 0x00E0) { //CLS
-                clearDisplay(chip);
-            } else if(instruction == 0x00EE) { //RET
-                chip->PC = chip->stack[chip->SP];
-                chip->SP = (chip->SP - 1) & 0xF;
-            }
-            break;
-
-        case 0x1: //JP addr
-            chip->PC = nnn;
-            break;
-
-        case 0x2: //CALL addr
-            chip->SP = (chip->SP + 1) & 0xF;
-            chip->stack[chip->SP] = chip->PC;
-            chip->PC = nnn;
-            break;
-
-        case 0x3: //SE Vx, byte
-            if(chip->V[x] == nn) {
-                chip->PC += 2;
-            }
-            break;
-
-        case 0x4: //SNE Vx, byte
-            if(chip->V[x] != nn) {
-                chip->PC += 2;
+            if(instruction == 0x00E0) {
+                entry->op = OP_CLS;
+            } else if(instruction == 0x00EE) {
+                entry->op = OP_RET;
+            } else if((instruction & 0xFFF0) == 0x00C0) {
+                entry->op = OP_SCD;
+            } else if((instruction & 0xFFF0) == 0x00D0) {
+                entry->op = OP_SCU;
+            } else if(instruction == 0x00FB) {
+                entry->op = OP_SCR;
+            } else if(instruction == 0x00FC) {
+                entry->op = OP_SCL;
+            } else if(instruction == 0x00FD) {
+                entry->op = OP_EXIT;
+            } else if(instruction == 0x00FE) {
+                entry->op = OP_LOW;
+            } else if(instruction == 0x00FF) {
+                entry->op = OP_HIGH;
+            } else {
+                entry->op = OP_SYS;
             }
             break;
-
-        case 0x5: //SE Vx, Vy
-            if(n == 0 && chip->V[x] == chip->V[y]) {
-                chip->PC += 2;
+        case 0x1: entry->op = OP_JP; break;
+        case 0x2: entry->op = OP_CALL; break;
+        case 0x3: entry->op = OP_SE_BYTE; break;
+        case 0x4: entry->op = OP_SNE_BYTE; break;
+        case 0x5:
+            switch(n) {
+                case 0x0: entry->op = OP_SE_REG; break;
+                case 0x2: entry->op = OP_SAVE_RANGE; break;
+                case 0x3: entry->op = OP_LOAD_RANGE; break;
             }
             break;
-
-        case 0x6: //LD Vx, byte
-            chip->V[x] = nn;
-            break;
-
-        case 0x7: //ADD Vx, byte
-            chip->V[x] += nn;
-            break;
-
+        case 0x6: entry->op = OP_LD_BYTE; break;
+        case 0x7: entry->op = OP_ADD_BYTE; break;
         case 0x8:
-            switch(instruction & 0xF) {
-                case 0x0: //LD Vx, Vy
-                    chip->V[x] = chip->V[y];
-                    break;
-                case 0x1: //OR Vx, Vy
-                    chip->V[x] |= chip->V[y];
-                    if (VF_RESET) {
-                        chip->V[0xF] = 0;
-                    }
-                    break;
-                case 0x2: //AND Vx, Vy
-                    chip->V[x] &= chip->V[y];
-                    if (VF_RESET) {
-                        chip->V[0xF] = 0;
-                    }
-                    break;
-                case 0x3: //XOR Vx, Vy
-                    chip->V[x] ^= chip->V[y];
-                    if (VF_RESET) {
-                        chip->V[0xF] = 0;
-                    }
-                    break;
-                case 0x4: //ADD Vx, Vy
-                    buffer = chip->V[x];
-                    chip->V[x] += chip->V[y];
-                    chip->V[0xF] = chip->V[x] < buffer;
-                    break;
-                case 0x5: //SUB Vx, Vy
-                    buffer = chip->V[x] >= chip->V[y];
-                    chip->V[x] = chip->V[x] - chip->V[y];
-                    chip->V[0xF] = buffer;
-                    break;
-                case 0x6: //SHR Vx
-                    if(SHIFTING) {
-                        chip->V[x] = chip->V[y];
-                    }
-                    buffer = chip->V[x] & 0b1;
-                    chip->V[x] >>= 1;
-                    chip->V[0xF] = buffer;
-                    break;
-                case 0x7: //SUBN Vx, Vy
-                    buffer = chip->V[y] >= chip->V[x];
-                    chip->V[x] = chip->V[y] - chip->V[x];
-                    chip->V[0xF] = buffer;
-                    break;
-                case 0xE: //SHL Vx
-                    if(SHIFTING) {
-                        chip->V[x] = chip->V[y];
-                    }
-                    buffer = (chip->V[x] >> 7) & 0b1;
-                    chip->V[x] <<= 1;
-                    chip->V[0xF] = buffer;
+            switch(n) {
+                case 0x0: entry->op = OP_LD_REG; break;
+                case 0x1: entry->op = OP_OR; break;
+                case 0x2: entry->op = OP_AND; break;
+                case 0x3: entry->op = OP_XOR; break;
+                case 0x4: entry->op = OP_ADD_REG; break;
+                case 0x5: entry->op = OP_SUB; break;
+                case 0x6: entry->op = OP_SHR; break;
+                case 0x7: entry->op = OP_SUBN; break;
+                case 0xE: entry->op = OP_SHL; break;
             }
             break;
-        case 0x9: //SNE Vx, Vy
-            if(n == 0) {
-                if(chip->V[x] != chip->V[y]) {
-                    chip->PC += 2;
-                }
-            }
-            break;
-        case 0xA: //LD I, addr
-            chip->I = nnn;
-            break;
-        case 0xB: //JP V0, addr
-            if(JUMPING) {
-                nnn += chip->V[x];
-            } else {
-                nnn += chip->V[0x0];
-            }
-            chip->PC = nnn;
-            break;
-        case 0xC: //RND Vx, byte
-            chip->V[x] = (rand() % nn) & nn;
-            break;
-        case 0xD: //DRW Vx, Vy, nibble
-            draw(chip, chip->V[x], chip->V[y], n);
+        case 0x9:
+            if(n == 0) { entry->op = OP_SNE_REG; }
             break;
+        case 0xA: entry->op = OP_LD_I; break;
+        case 0xB: entry->op = OP_JP_V0; break;
+        case 0xC: entry->op = OP_RND; break;
+        case 0xD: entry->op = OP_DRW; break;
         case 0xE:
-            switch (nn) {
-                case 0x9E: //SKP Vx
-                    if(chip->keys[chip->V[x] & 0xF] == 0x1) {
-                        chip->PC += 2;
-                    }
-                    break;
-                case 0xA1: //SKNP Vx
-                    if(chip->keys[chip->V[x] & 0xF] == 0x0) {
-                        chip->PC += 2;
-                    }
-                    break;
+            switch(nn) {
+                case 0x9E: entry->op = OP_SKP; break;
+                case 0xA1: entry->op = OP_SKNP; break;
             }
             break;
         case 0xF:
-            switch (nn) {
-                case 0x07: //LD Vx, DT
-                    chip->V[x] = chip->DT;
-                    break;
-                case 0x0A: //LD Vx, K
-                    for(byte i = 0; i < 0x10; i++) {
-                        if(chip->keysNow[i] == 1) {
-                            chip->V[x] = i;
-                            buffer = 1;
-                        }
-                    }
-                    if (buffer == 0) {
-                        chip->PC -= 2;
-                    }
-                    break;
-                case 0x15: //LD DT, Vx
-                    chip->DT = chip->V[x];
-                    break;
-                case 0x18: //LD ST, Vx
-                    chip->ST = chip->V[x];
-                    break;
-                case 0x1E: //ADD I, Vx
-                    writeI(chip, chip->I + chip->V[x]);
-                    break;
-                case 0x29: //LD F, Vx
-                    writeI(chip, (chip->V[x] & 0xF) * 0x5);
-                    break;
-                case 0x33: //LD B, Vx
-                    buffer = chip->V[x];
-                    for(int i = 0; i < 3; i++) {
-                        writeMemory(chip, chip->I + (2 - i), buffer % 10);
-                        buffer /= 10;
-                    }
-                    break;
-                case 0x55: //LD [I], Vx
-                    for(int i = 0; i <= x; i++) {
-                        writeMemory(chip, chip->I + i, chip->V[i]);
-                    }
-                    if (MEMORY) { writeI(chip, chip->I + x + 1); }
-                    break;
-                case 0x65: //LD Vx, [I]
-                    for(int i = 0; i <= x; i++) {
-                        chip->V[i] = readMemory(chip, chip->I + i);
-                    }
-                    if (MEMORY) { writeI(chip, chip->I + x + 1); }
-                    break;
+            if(instruction == 0xF000) {
+                // The address is the word after the instruction
+                entry->op = OP_LD_I_LONG;
+                entry->nnn = parseWord(readMemory(chip, address + 2), readMemory(chip, address + 3));
+                break;
+            }
+            switch(nn) {
+                case 0x01: entry->op = OP_PLANE; break;
+                case 0x07: entry->op = OP_LD_VX_DT; break;
+                case 0x0A: entry->op = OP_LD_VX_K; break;
+                case 0x15: entry->op = OP_LD_DT_VX; break;
+                case 0x18: entry->op = OP_LD_ST_VX; break;
+                case 0x1E: entry->op = OP_ADD_I; break;
+                case 0x29: entry->op = OP_LD_F; break;
+                case 0x30: entry->op = OP_LD_HF; break;
+                case 0x33: entry->op = OP_LD_B; break;
+                case 0x55: entry->op = OP_LD_MEM_VX; break;
+                case 0x65: entry->op = OP_LD_VX_MEM; break;
+                case 0x75: entry->op = OP_LD_R_VX; break;
+                case 0x85: entry->op = OP_LD_VX_R; break;
             }
             break;
     }
-    return SUCCESS;
 }
 
-void draw(chip8 *chip, byte x, byte y, byte size) {
-    x = x % SCREEN_X;
-    y = y % SCREEN_Y;
-    chip->V[0xF] = 0;
-
-    for(byte i = 0; i < size; i++) {
-        byte spriteByte = chip->memory[(chip->I+i) & 0x0FFF];
-        if (y + i == SCREEN_Y && CLIPPING) { break; }
-        byte localY = (y + i) % SCREEN_Y;
-
-        for(byte j = 0; j < 8; j++) {
-            if (x + j == SCREEN_X && CLIPPING) { break; }
-            byte localX = (x + j) % SCREEN_X;
-
-            if((spriteByte >> (7 - j)) & 1) {
-                chip->V[0xF] = chip->V[0xF] | chip->screen[localY][localX];
-                chip->screen[localY][localX] ^= 1;
-            }
+// A short backward jump over instructions that only poll DT or the keys, compare and reload
+// constants repeats the same pass until the next timer tick or key event
+byte isIdleLoop(chip8* chip, word jump, const decoded* d) {
+    if (d->nnn > jump || jump - d->nnn > IDLE_LOOP_BYTES) {
+        return 0;
+    }
+    for (word address = d->nnn; address < jump; address += 2) {
+        decoded* body = &chip->cache[address];
+        if (body->op == OP_UNDECODED) {
+            decodeInstruction(chip, address, body);
+        }
+        switch (body->op) {
+            case OP_LD_VX_DT:
+            case OP_LD_BYTE:
+            case OP_SE_BYTE:
+            case OP_SNE_BYTE:
+            case OP_SE_REG:
+            case OP_SNE_REG:
+            case OP_SKP:
+            case OP_SKNP:
+                break;
+            default:
+                return 0;
+        }
+    }
+    return 1;
+}
+
+static inline decoded* fetchInstruction(chip8* chip) {
+    word address = chip->PC & chip->memoryMask;
+    decoded* d = &chip->cache[address];
+    if (d->op == OP_UNDECODED) {
+        decodeInstruction(chip, address, d);
+    }
+    chip->PC = (address + 2) & chip->memoryMask;
+    return d;
+}
+
+// Records how many of the budget's instructions retired and leaves the core
+#define CORE_EXIT(reason) do { \
+        chip->instructions += budget - count; \
+        return reason; \
+    } while (0)
+
+#define CORE_QUIRKS 0
+#include "chip8core.inc"
+#define CORE_QUIRKS 1
+#include "chip8core.inc"
+#define CORE_QUIRKS 2
+#include "chip8core.inc"
+#define CORE_QUIRKS 3
+#include "chip8core.inc"
+#define CORE_QUIRKS 4
+#include "chip8core.inc"
+#define CORE_QUIRKS 5
+#include "chip8core.inc"
+#define CORE_QUIRKS 6
+#include "chip8core.inc"
+#define CORE_QUIRKS 7
+#include "chip8core.inc"
+#define CORE_QUIRKS 8
+#include "chip8core.inc"
+#define CORE_QUIRKS 9
+#include "chip8core.inc"
+#define CORE_QUIRKS 10
+#include "chip8core.inc"
+#define CORE_QUIRKS 11
+#include "chip8core.inc"
+#define CORE_QUIRKS 12
+#include "chip8core.inc"
+#define CORE_QUIRKS 13
+#include "chip8core.inc"
+#define CORE_QUIRKS 14
+#include "chip8core.inc"
+#define CORE_QUIRKS 15
+#include "chip8core.inc"
+#define CORE_QUIRKS 16
+#include "chip8core.inc"
+#define CORE_QUIRKS 17
+#include "chip8core.inc"
+#define CORE_QUIRKS 18
+#include "chip8core.inc"
+#define CORE_QUIRKS 19
+#include "chip8core.inc"
+#define CORE_QUIRKS 20
+#include "chip8core.inc"
+#define CORE_QUIRKS 21
+#include "chip8core.inc"
+#define CORE_QUIRKS 22
+#include "chip8core.inc"
+#define CORE_QUIRKS 23
+#include "chip8core.inc"
+#define CORE_QUIRKS 24
+#include "chip8core.inc"
+#define CORE_QUIRKS 25
+#include "chip8core.inc"
+#define CORE_QUIRKS 26
+#include "chip8core.inc"
+#define CORE_QUIRKS 27
+#include "chip8core.inc"
+#define CORE_QUIRKS 28
+#include "chip8core.inc"
+#define CORE_QUIRKS 29
+#include "chip8core.inc"
+#define CORE_QUIRKS 30
+#include "chip8core.inc"
+#define CORE_QUIRKS 31
+#include "chip8core.inc"
+
+#define PROFILE_CORES(q) { \
+        [CORE_SWITCH] = runSwitch_##q, \
+        [CORE_TABLE] = runTable_##q, \
+        [CORE_THREADED] = runThreaded_##q, \
+        [CORE_JIT] = runJit, \
+        [CORE_AOT] = runAot, \
+    },
+
+static chip8stop (*const CORES[QUIRK_PROFILES][CORE_COUNT])(chip8* chip, int budget) = {
+    PROFILE_CORES(0) PROFILE_CORES(1) PROFILE_CORES(2) PROFILE_CORES(3) PROFILE_CORES(4) PROFILE_CORES(5) PROFILE_CORES(6) PROFILE_CORES(7)
+    PROFILE_CORES(8) PROFILE_CORES(9) PROFILE_CORES(10) PROFILE_CORES(11) PROFILE_CORES(12) PROFILE_CORES(13) PROFILE_CORES(14) PROFILE_CORES(15)
+    PROFILE_CORES(16) PROFILE_CORES(17) PROFILE_CORES(18) PROFILE_CORES(19) PROFILE_CORES(20) PROFILE_CORES(21) PROFILE_CORES(22) PROFILE_CORES(23)
+    PROFILE_CORES(24) PROFILE_CORES(25) PROFILE_CORES(26) PROFILE_CORES(27) PROFILE_CORES(28) PROFILE_CORES(29) PROFILE_CORES(30) PROFILE_CORES(31)
+};
+
+static void (*const DRAWS[QUIRK_PROFILES])(chip8* chip, byte x, byte y, byte size) = {
+    draw_0, draw_1, draw_2, draw_3, draw_4, draw_5, draw_6, draw_7,
+    draw_8, draw_9, draw_10, draw_11, draw_12, draw_13, draw_14, draw_15,
+    draw_16, draw_17, draw_18, draw_19, draw_20, draw_21, draw_22, draw_23,
+    draw_24, draw_25, draw_26, draw_27, draw_28, draw_29, draw_30, draw_31,
+};
+
+void setCore(chip8* chip, chip8core core) {
+    if (core < CORE_COUNT) {
+        chip->core = core;
+        chip->run = CORES[chip->quirks][core];
+    }
+}
+
+// xorshift32 stays at zero once there, so a zero seed falls back to the default one
+void seedChip(chip8* chip, uint32_t seed) {
+    chip->rng = seed ? seed : DEFAULT_SEED;
+}
+
+void setQuirks(chip8* chip, byte quirks) {
+    chip->quirks = quirks & (QUIRK_PROFILES - 1);
+    chip->run = CORES[chip->quirks][chip->core];
+    if (chip->jit) {
+        jitFlush(chip->jit);
+    }
+}
+
+// Only the emulated clock looks at the timing; the cores run the same either way
+void setTiming(chip8* chip, chip8timing timing) {
+    chip->timing = timing;
+    chip->displayWait = 0;
+}
+
+chip8stop runInterpreter(chip8* chip, int budget) {
+    return CORES[chip->quirks][CORE_SWITCH](chip, budget);
+}
+
+void setBreakpoint(chip8* chip, word address, byte enabled) {
+    if (chip->breakpoints[address] != enabled) {
+        chip->breakpoints[address] = enabled;
+        chip->breakpointCount += enabled ? 1 : -1;
+    }
+}
+
+chip8stop runCycles(chip8* chip, int budget) {
+    if (chip->breakpointCount == 0 && chip->trace == NULL) {
+        return chip->run(chip, budget);
+    }
+
+    // Single-step so no breakpoint is passed and every instruction is traced; the breakpoint we
+    // stopped on last time runs on resume
+    byte resuming = chip->atBreakpoint;
+    chip->atBreakpoint = 0;
+    while (budget > 0) {
+        if (chip->breakpoints[chip->PC & chip->memoryMask] && !resuming) {
+            chip->atBreakpoint = 1;
+            return STOP_BREAKPOINT;
+        }
+        resuming = 0;
+        if (chip->trace) {
+            traceInstruction(chip->trace, chip);
         }
+        chip8stop stop = chip->run(chip, 1);
+        budget--;
+        if (stop != STOP_BUDGET) {
+            return stop;
+        }
+    }
+    return STOP_BUDGET;
+}
+
+chip8result executeInstruction(chip8 *chip) {
+    if (runCycles(chip, 1) == STOP_UNKNOWN) {
+        return ERROR;
     }
+    return SUCCESS;
+}
+
+void draw(chip8 *chip, byte x, byte y, byte size) {
+    DRAWS[chip->quirks](chip, x, y, size);
 }
 
 chip8* initChip(const char *rom_path) {
     chip8* chip = createChip();
-    byte buffer[0xE00];
+    static byte buffer[0xFE00];
     FILE* file = fopen(rom_path, "rb");
-    int size = fread(&buffer, 1, 0xE00, file);
+    int size = fread(&buffer, 1, sizeof(buffer), file);
     fclose(file);
     writeROM(chip, buffer, size);
     return chip;
@@ -292,15 +567,74 @@ void updateTimers(chip8 *chip) {
 }
 
 void writeMemory(chip8 *chip, word address, byte value) {
-    chip->memory[address & 0x0FFF] = value;
+    address &= chip->memoryMask;
+    chip->memory[address] = value;
+    // The byte belongs to the instruction starting here and to the ones up to three bytes before
+    // it, the length of F000 nnnn
+    for (word back = 0; back < 4; back++) {
+        chip->cache[(address - back) & chip->memoryMask].op = OP_UNDECODED;
+    }
+    // Translated code only ever covers the first 4 KiB
+    if (address >= 0x1000) {
+        return;
+    }
+    if (chip->jit) {
+        jitInvalidate(chip->jit, address);
+    }
+    if (chip->aot) {
+        aotInvalidate(chip->aot, address);
+    }
+}
+
+#define SNAPSHOT_FIELDS(copy) \
+    copy(screen) copy(hires) copy(flags) copy(planes) copy(memoryMask) copy(stack) copy(V) copy(I) \
+    copy(DT) copy(ST) copy(PC) copy(SP) copy(keys) copy(keysNow) copy(screenGeneration) \
+    copy(dirtyRows) copy(instructions) copy(cycles) copy(displayWait) copy(rng)
+
+void saveChip(const chip8* chip, chip8snapshot* snapshot) {
+#define SAVE_FIELD(name) memcpy(&snapshot->name, &chip->name, sizeof(chip->name));
+    SNAPSHOT_FIELDS(SAVE_FIELD)
+#undef SAVE_FIELD
+    memcpy(snapshot->memory, chip->memory, chip->memoryMask + 1);
+}
+
+// Memory goes back through writeMemory, and only where it differs, so the decode cache and translated
+// code stay valid for everything the ROM did not write since saveChip
+void restoreChip(chip8* chip, const chip8snapshot* snapshot) {
+    for (unsigned int address = 0; address <= snapshot->memoryMask; address += sizeof(uint64_t)) {
+        uint64_t now, then;
+        memcpy(&now, &chip->memory[address], sizeof(now));
+        memcpy(&then, &snapshot->memory[address], sizeof(then));
+        if (now == then) {
+            continue;
+        }
+        for (unsigned int i = address; i < address + sizeof(uint64_t); i++) {
+            if (chip->memory[i] != snapshot->memory[i]) {
+                writeMemory(chip, i, snapshot->memory[i]);
+            }
+        }
+    }
+#define RESTORE_FIELD(name) memcpy(&chip->name, &snapshot->name, sizeof(chip->name));
+    SNAPSHOT_FIELDS(RESTORE_FIELD)
+#undef RESTORE_FIELD
 }
 
 byte readMemory(chip8 *chip, word address) {
-    return chip->memory[address & 0x0FFF];
+    return chip->memory[address & chip->memoryMask];
 }
 
 void writeI(chip8* chip, word value) {
-    chip->I = value & 0x0FFF;
+    chip->I = value & chip->memoryMask;
+}
+
+// XO-CHIP: 64 KiB of memory, so I and PC keep all 16 bits
+void setExtendedMemory(chip8* chip, byte extended) {
+    chip->memoryMask = extended ? 0xFFFF : 0x0FFF;
+    memset(chip->cache, 0, sizeof(chip->cache));
+    if (chip->jit) {
+        // Translated Fx1E masks I with the mask it was compiled under
+        jitFlush(chip->jit);
+    }
 }
 
 
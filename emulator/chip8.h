@@ -1,11 +1,113 @@
 #ifndef CHIP8_H
 #define CHIP8_H
+#include <stdint.h>
+
 #include "config.h"
 #include "definitions.h"
 
+// Lores mode uses the top left SCREEN_X by SCREEN_Y corner
+#ifdef CHIP8_PACKED_SCREEN
+#ifndef __SIZEOF_INT128__
+#error CHIP8_PACKED_SCREEN needs a compiler with 128-bit integers
+#endif
+// One bit per pixel and plane, the leftmost pixel in the most significant bit
+typedef unsigned __int128 screenRow;
+typedef screenRow chip8screen[SCREEN_PLANES][HIRES_Y];
+#else
+// One byte per pixel, bit p set when the pixel is on in plane p
+typedef byte chip8screen[HIRES_Y][HIRES_X];
+#endif
+
+typedef enum opcode {
+    OP_UNDECODED,
+    OP_SYS,
+    OP_UNKNOWN,
+    OP_CLS,
+    OP_RET,
+    OP_JP,
+    OP_CALL,
+    OP_SE_BYTE,
+    OP_SNE_BYTE,
+    OP_SE_REG,
+    OP_LD_BYTE,
+    OP_ADD_BYTE,
+    OP_LD_REG,
+    OP_OR,
+    OP_AND,
+    OP_XOR,
+    OP_ADD_REG,
+    OP_SUB,
+    OP_SHR,
+    OP_SUBN,
+    OP_SHL,
+    OP_SNE_REG,
+    OP_LD_I,
+    OP_JP_V0,
+    OP_RND,
+    OP_DRW,
+    OP_SKP,
+    OP_SKNP,
+    OP_LD_VX_DT,
+    OP_LD_VX_K,
+    OP_LD_DT_VX,
+    OP_LD_ST_VX,
+    OP_ADD_I,
+    OP_LD_F,
+    OP_LD_B,
+    OP_LD_MEM_VX,
+    OP_LD_VX_MEM,
+    OP_SCD,
+    OP_SCR,
+    OP_SCL,
+    OP_EXIT,
+    OP_LOW,
+    OP_HIGH,
+    OP_LD_HF,
+    OP_LD_R_VX,
+    OP_LD_VX_R,
+    OP_SCU,
+    OP_LD_I_LONG,
+    OP_PLANE,
+    OP_SAVE_RANGE,
+    OP_LOAD_RANGE,
+    OP_COUNT
+} opcode;
+
+// Instruction predecoded once per address, reused until memory under it changes
+typedef struct decoded {
+    byte op;
+    byte x;
+    byte y;
+    byte n;
+    byte nn;
+    word nnn;
+} decoded;
+
+typedef enum chip8core {
+    CORE_SWITCH,
+    CORE_TABLE,
+    CORE_THREADED,
+    CORE_JIT,
+    CORE_AOT,
+    CORE_COUNT
+} chip8core;
+
+// How emulated time is spent: on instructions, or on COSMAC VIP machine cycles
+typedef enum chip8timing {
+    TIMING_INSTRUCTIONS,
+    TIMING_VIP
+} chip8timing;
+
 typedef struct chip8 {
-    byte screen[SCREEN_Y][SCREEN_X];
-    byte memory[0x1000];
+    chip8screen screen;
+    byte hires;
+    // SUPER-CHIP RPL user flags, saved and restored by Fx75 and Fx85
+    byte flags[0x10];
+    // XO-CHIP planes selected by Fn01, drawn, cleared and scrolled together
+    byte planes;
+    byte memory[0x10000];
+    // 0x0FFF, or 0xFFFF once setExtendedMemory enabled the XO-CHIP address space
+    word memoryMask;
     word stack[0x10];
     byte V[0x10];
     word I;
@@ -15,18 +117,85 @@ typedef struct chip8 {
     word SP;
     byte keys[0x10];
     byte keysNow[0x10];
+    // Bumped by every draw and clear, so the frontend can tell the screen has not changed
+    unsigned int screenGeneration;
+    // One bit per screen row written since the frontend last called takeDirtyRows
+    uint64_t dirtyRows;
+    byte core;
+    byte quirks;
+    enum chip8stop (*run)(struct chip8* chip, int budget);
+    unsigned long long instructions;
+    byte timing;
+    // Machine cycles spent under TIMING_VIP, and where its display wait stands
+    unsigned long long cycles;
+    byte displayWait;
+    // Cxkk generator state, never zero
+    uint32_t rng;
+    word breakpointCount;
+    byte atBreakpoint;
+    byte breakpoints[0x10000];
+    struct jitState* jit;
+    struct aotState* aot;
+    struct traceBuffer* trace;
+    decoded cache[0x10000];
 } chip8;
 
+// Everything a ROM can observe, for cheap save and restore: no decode cache, breakpoints or
+// translated code, and memory only up to memoryMask
+typedef struct chip8snapshot {
+    chip8screen screen;
+    byte hires;
+    byte flags[0x10];
+    byte planes;
+    word memoryMask;
+    word stack[0x10];
+    byte V[0x10];
+    word I;
+    word DT;
+    word ST;
+    word PC;
+    word SP;
+    byte keys[0x10];
+    byte keysNow[0x10];
+    unsigned int screenGeneration;
+    uint64_t dirtyRows;
+    unsigned long long instructions;
+    unsigned long long cycles;
+    byte displayWait;
+    uint32_t rng;
+    byte memory[0x10000];
+} chip8snapshot;
+
 typedef enum chip8result {
     SUCCESS,
     ERROR
 } chip8result;
 
+// Why runCycles handed control back to the caller
+typedef enum chip8stop {
+    STOP_NONE,
+    STOP_BUDGET,
+    STOP_WAITING,
+    STOP_DRAW,
+    STOP_UNKNOWN,
+    STOP_BREAKPOINT,
+    STOP_IDLE,
+    STOP_EXIT
+} chip8stop;
+
 chip8* createChip();
+void destroyChip(chip8* chip);
 void resetChip(chip8* chip);
 void clearDisplay(chip8* chip);
+void markScreenDirty(chip8* chip);
+void setHires(chip8* chip, byte hires);
+void scrollDown(chip8* chip, byte rows);
+void scrollUp(chip8* chip, byte rows);
+void scrollRight(chip8* chip);
+void scrollLeft(chip8* chip);
+uint64_t takeDirtyRows(chip8* chip);
 void draw(chip8* chip, byte x, byte y, byte size);
-void writeROM(chip8* chip, byte* rom, word size);
+void writeROM(chip8* chip, const byte* rom, word size);
 byte readByte(chip8* chip);
 word readWord(chip8* chip);
 chip8result executeInstruction(chip8* chip);
@@ -35,7 +204,41 @@ void updateTimers(chip8* chip);
 void writeMemory(chip8* chip, word address, byte value);
 byte readMemory(chip8* chip, word address);
 void writeI(chip8* chip, word value);
+void decodeInstruction(chip8* chip, word address, decoded* entry);
+byte isIdleLoop(chip8* chip, word jump, const decoded* d);
+void setCore(chip8* chip, chip8core core);
+void setQuirks(chip8* chip, byte quirks);
+void seedChip(chip8* chip, uint32_t seed);
+void setTiming(chip8* chip, chip8timing timing);
+chip8stop runInterpreter(chip8* chip, int budget);
+chip8stop runCycles(chip8* chip, int budget);
+void setBreakpoint(chip8* chip, word address, byte enabled);
+void setExtendedMemory(chip8* chip, byte extended);
+void saveChip(const chip8* chip, chip8snapshot* snapshot);
+void restoreChip(chip8* chip, const chip8snapshot* snapshot);
+
+static inline byte screenWidth(const chip8* chip) {
+    return chip->hires ? HIRES_X : SCREEN_X;
+}
 
+static inline byte screenHeight(const chip8* chip) {
+    return chip->hires ? HIRES_Y : SCREEN_Y;
+}
+
+static inline byte screenPixel(const chip8screen* screen, byte x, byte y) {
+#ifdef CHIP8_PACKED_SCREEN
+    byte value = 0;
+    for (byte p = 0; p < SCREEN_PLANES; p++) {
+        value |= (((*screen)[p][y] >> (HIRES_X - 1 - x)) & 1) << p;
+    }
+    return value;
+#else
+    return (*screen)[y][x];
+#endif
+}
 
+static inline byte getPixel(const chip8* chip, byte x, byte y) {
+    return screenPixel(&chip->screen, x, y);
+}
 
 #endif
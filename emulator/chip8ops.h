@@ -0,0 +1,333 @@
+#ifndef CHIP8OPS_H
+#define CHIP8OPS_H
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "chip8.h"
+#include "config.h"
+
+// Opcode handlers shared by the interpreter cores and by recompiled code.
+// Each one runs with PC already past the instruction and returns why execution should stop.
+
+// Skips the instruction at PC, all four bytes of it when it is XO-CHIP F000 nnnn
+static inline void skipInstruction(chip8* chip) {
+    word next = chip->PC & chip->memoryMask;
+    byte isLong = chip->memory[next] == 0xF0 && chip->memory[(next + 1) & chip->memoryMask] == 0x00;
+    chip->PC = next + (isLong ? 4 : 2);
+}
+
+static inline chip8stop opCLS(chip8* chip, const decoded* d) {
+    clearDisplay(chip);
+    return STOP_DRAW;
+}
+
+static inline chip8stop opRET(chip8* chip, const decoded* d) {
+    chip->PC = chip->stack[chip->SP];
+    chip->SP = (chip->SP - 1) & 0xF;
+    return STOP_NONE;
+}
+
+static inline chip8stop opJP(chip8* chip, const decoded* d) {
+    word jump = (chip->PC - 2) & chip->memoryMask;
+    chip->PC = d->nnn;
+    if (d->nnn <= jump && isIdleLoop(chip, jump, d)) {
+        return STOP_IDLE;
+    }
+    return STOP_NONE;
+}
+
+static inline chip8stop opCALL(chip8* chip, const decoded* d) {
+    chip->SP = (chip->SP + 1) & 0xF;
+    chip->stack[chip->SP] = chip->PC;
+    chip->PC = d->nnn;
+    return STOP_NONE;
+}
+
+static inline chip8stop opSE_BYTE(chip8* chip, const decoded* d) {
+    if(chip->V[d->x] == d->nn) {
+        skipInstruction(chip);
+    }
+    return STOP_NONE;
+}
+
+static inline chip8stop opSNE_BYTE(chip8* chip, const decoded* d) {
+    if(chip->V[d->x] != d->nn) {
+        skipInstruction(chip);
+    }
+    return STOP_NONE;
+}
+
+static inline chip8stop opSE_REG(chip8* chip, const decoded* d) {
+    if(chip->V[d->x] == chip->V[d->y]) {
+        skipInstruction(chip);
+    }
+    return STOP_NONE;
+}
+
+static inline chip8stop opLD_BYTE(chip8* chip, const decoded* d) {
+    chip->V[d->x] = d->nn;
+    return STOP_NONE;
+}
+
+static inline chip8stop opADD_BYTE(chip8* chip, const decoded* d) {
+    chip->V[d->x] += d->nn;
+    return STOP_NONE;
+}
+
+static inline chip8stop opLD_REG(chip8* chip, const decoded* d) {
+    chip->V[d->x] = chip->V[d->y];
+    return STOP_NONE;
+}
+
+static inline chip8stop opADD_REG(chip8* chip, const decoded* d) {
+    byte buffer = chip->V[d->x];
+    chip->V[d->x] += chip->V[d->y];
+    chip->V[0xF] = chip->V[d->x] < buffer;
+    return STOP_NONE;
+}
+
+static inline chip8stop opSUB(chip8* chip, const decoded* d) {
+    byte buffer = chip->V[d->x] >= chip->V[d->y];
+    chip->V[d->x] = chip->V[d->x] - chip->V[d->y];
+    chip->V[0xF] = buffer;
+    return STOP_NONE;
+}
+
+static inline chip8stop opSUBN(chip8* chip, const decoded* d) {
+    byte buffer = chip->V[d->y] >= chip->V[d->x];
+    chip->V[d->x] = chip->V[d->y] - chip->V[d->x];
+    chip->V[0xF] = buffer;
+    return STOP_NONE;
+}
+
+static inline chip8stop opSNE_REG(chip8* chip, const decoded* d) {
+    if(chip->V[d->x] != chip->V[d->y]) {
+        skipInstruction(chip);
+    }
+    return STOP_NONE;
+}
+
+static inline chip8stop opLD_I(chip8* chip, const decoded* d) {
+    chip->I = d->nnn;
+    return STOP_NONE;
+}
+
+// xorshift32 on the chip's own state, so runs replay exactly from a snapshot or a seed
+static inline chip8stop opRND(chip8* chip, const decoded* d) {
+    chip->rng ^= chip->rng << 13;
+    chip->rng ^= chip->rng >> 17;
+    chip->rng ^= chip->rng << 5;
+    chip->V[d->x] = (chip->rng >> 24) & d->nn;
+    return STOP_NONE;
+}
+
+static inline chip8stop opSKP(chip8* chip, const decoded* d) {
+    if(chip->keys[chip->V[d->x] & 0xF] == 0x1) {
+        skipInstruction(chip);
+    }
+    return STOP_NONE;
+}
+
+static inline chip8stop opSKNP(chip8* chip, const decoded* d) {
+    if(chip->keys[chip->V[d->x] & 0xF] == 0x0) {
+        skipInstruction(chip);
+    }
+    return STOP_NONE;
+}
+
+static inline chip8stop opLD_VX_DT(chip8* chip, const decoded* d) {
+    chip->V[d->x] = chip->DT;
+    return STOP_NONE;
+}
+
+// Each release is reported once, so a second Fx0A waits for the next one
+static inline chip8stop opLD_VX_K(chip8* chip, const decoded* d) {
+    byte buffer = 0;
+    for(byte i = 0; i < 0x10; i++) {
+        if(chip->keysNow[i] == 1) {
+            chip->V[d->x] = i;
+            buffer = 1;
+        }
+    }
+    if (buffer == 0) {
+        chip->PC -= 2;
+        return STOP_WAITING;
+    }
+    chip->keysNow[chip->V[d->x]] = 0;
+    return STOP_NONE;
+}
+
+static inline chip8stop opLD_DT_VX(chip8* chip, const decoded* d) {
+    chip->DT = chip->V[d->x];
+    return STOP_NONE;
+}
+
+static inline chip8stop opLD_ST_VX(chip8* chip, const decoded* d) {
+    chip->ST = chip->V[d->x];
+    return STOP_NONE;
+}
+
+static inline chip8stop opADD_I(chip8* chip, const decoded* d) {
+    writeI(chip, chip->I + chip->V[d->x]);
+    return STOP_NONE;
+}
+
+static inline chip8stop opLD_F(chip8* chip, const decoded* d) {
+    writeI(chip, (chip->V[d->x] & 0xF) * 0x5);
+    return STOP_NONE;
+}
+
+static inline chip8stop opLD_B(chip8* chip, const decoded* d) {
+    byte buffer = chip->V[d->x];
+    for(int i = 0; i < 3; i++) {
+        writeMemory(chip, chip->I + (2 - i), buffer % 10);
+        buffer /= 10;
+    }
+    return STOP_NONE;
+}
+
+static inline chip8stop opSCD(chip8* chip, const decoded* d) {
+    scrollDown(chip, d->n);
+    return STOP_DRAW;
+}
+
+static inline chip8stop opSCR(chip8* chip, const decoded* d) {
+    scrollRight(chip);
+    return STOP_DRAW;
+}
+
+static inline chip8stop opSCL(chip8* chip, const decoded* d) {
+    scrollLeft(chip);
+    return STOP_DRAW;
+}
+
+// 00FD stays on itself, so the program remains stopped however often it is resumed
+static inline chip8stop opEXIT(chip8* chip, const decoded* d) {
+    chip->PC = (chip->PC - 2) & chip->memoryMask;
+    return STOP_EXIT;
+}
+
+static inline chip8stop opLOW(chip8* chip, const decoded* d) {
+    setHires(chip, 0);
+    return STOP_DRAW;
+}
+
+static inline chip8stop opHIGH(chip8* chip, const decoded* d) {
+    setHires(chip, 1);
+    return STOP_DRAW;
+}
+
+static inline chip8stop opLD_HF(chip8* chip, const decoded* d) {
+    writeI(chip, BIG_DIGITS_ADDRESS + (chip->V[d->x] % 10) * 10);
+    return STOP_NONE;
+}
+
+static inline chip8stop opLD_R_VX(chip8* chip, const decoded* d) {
+    memcpy(chip->flags, chip->V, d->x + 1);
+    return STOP_NONE;
+}
+
+static inline chip8stop opLD_VX_R(chip8* chip, const decoded* d) {
+    memcpy(chip->V, chip->flags, d->x + 1);
+    return STOP_NONE;
+}
+
+static inline chip8stop opSCU(chip8* chip, const decoded* d) {
+    scrollUp(chip, d->n);
+    return STOP_DRAW;
+}
+
+// F000 nnnn: the address word was decoded with the instruction, PC still has to step over it
+static inline chip8stop opLD_I_LONG(chip8* chip, const decoded* d) {
+    writeI(chip, d->nnn);
+    chip->PC = (chip->PC + 2) & chip->memoryMask;
+    return STOP_NONE;
+}
+
+static inline chip8stop opPLANE(chip8* chip, const decoded* d) {
+    chip->planes = d->x & ((1 << SCREEN_PLANES) - 1);
+    return STOP_NONE;
+}
+
+// 5xy2 and 5xy3 run from Vx to Vy in either direction and leave I alone
+static inline chip8stop opSAVE_RANGE(chip8* chip, const decoded* d) {
+    int step = d->x <= d->y ? 1 : -1;
+    for (int i = 0; i <= abs(d->y - d->x); i++) {
+        writeMemory(chip, chip->I + i, chip->V[d->x + i * step]);
+    }
+    return STOP_NONE;
+}
+
+static inline chip8stop opLOAD_RANGE(chip8* chip, const decoded* d) {
+    int step = d->x <= d->y ? 1 : -1;
+    for (int i = 0; i <= abs(d->y - d->x); i++) {
+        chip->V[d->x + i * step] = readMemory(chip, chip->I + i);
+    }
+    return STOP_NONE;
+}
+
+static inline chip8stop opSYS(chip8* chip, const decoded* d) {
+    return STOP_NONE;
+}
+
+static inline chip8stop opUNKNOWN(chip8* chip, const decoded* d) {
+    return STOP_UNKNOWN;
+}
+
+// Every opcode class with its handler, expanded into each dispatch core below
+#define OPCODE_HANDLERS(X) \
+    X(SYS) X(UNKNOWN) X(CLS) X(RET) X(JP) X(CALL) X(SE_BYTE) X(SNE_BYTE) X(SE_REG) \
+    X(LD_BYTE) X(ADD_BYTE) X(LD_REG) X(ADD_REG) X(SUB) X(SUBN) X(SNE_REG) \
+    X(LD_I) X(RND) X(SKP) X(SKNP) X(LD_VX_DT) X(LD_VX_K) X(LD_DT_VX) X(LD_ST_VX) \
+    X(ADD_I) X(LD_F) X(LD_B) X(SCD) X(SCR) X(SCL) X(EXIT) X(LOW) X(HIGH) X(LD_HF) \
+    X(LD_R_VX) X(LD_VX_R) X(SCU) X(LD_I_LONG) X(PLANE) X(SAVE_RANGE) X(LOAD_RANGE)
+
+// Handlers whose behaviour depends on the quirk profile, defined per profile in chip8core.inc
+#define QUIRK_HANDLERS(X) \
+    X(OR) X(AND) X(XOR) X(SHR) X(SHL) X(JP_V0) X(DRW) X(LD_MEM_VX) X(LD_VX_MEM)
+
+typedef chip8stop (*opHandler)(chip8* chip, const decoded* d);
+
+#ifndef CHIP8_PACKED_SCREEN
+// Sprite byte expanded to the 8 screen bytes it covers, in memory order, so a row is drawn with one
+// 64-bit XOR. Pixel j (bit 7 - j of the sprite) lands in byte j of the span.
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+#define SPRITE_PIXEL(s, j) ((uint64_t)(((s) >> (7 - (j))) & 1) << (8 * (7 - (j))))
+#else
+#define SPRITE_PIXEL(s, j) ((uint64_t)(((s) >> (7 - (j))) & 1) << (8 * (j)))
+#endif
+#define SPRITE_PIXELS_1(s) (SPRITE_PIXEL(s, 0) | SPRITE_PIXEL(s, 1) | SPRITE_PIXEL(s, 2) | SPRITE_PIXEL(s, 3) | \
+        SPRITE_PIXEL(s, 4) | SPRITE_PIXEL(s, 5) | SPRITE_PIXEL(s, 6) | SPRITE_PIXEL(s, 7)),
+#define SPRITE_PIXELS_4(s) SPRITE_PIXELS_1(s) SPRITE_PIXELS_1(s + 1) SPRITE_PIXELS_1(s + 2) SPRITE_PIXELS_1(s + 3)
+#define SPRITE_PIXELS_16(s) SPRITE_PIXELS_4(s) SPRITE_PIXELS_4(s + 4) SPRITE_PIXELS_4(s + 8) SPRITE_PIXELS_4(s + 12)
+#define SPRITE_PIXELS_64(s) SPRITE_PIXELS_16(s) SPRITE_PIXELS_16(s + 16) SPRITE_PIXELS_16(s + 32) SPRITE_PIXELS_16(s + 48)
+
+static const uint64_t SPRITE_PIXELS[0x100] = {
+    SPRITE_PIXELS_64(0) SPRITE_PIXELS_64(64) SPRITE_PIXELS_64(128) SPRITE_PIXELS_64(192)
+};
+
+#undef SPRITE_PIXELS_64
+#undef SPRITE_PIXELS_16
+#undef SPRITE_PIXELS_4
+#undef SPRITE_PIXELS_1
+#undef SPRITE_PIXEL
+
+// XORs one sprite byte into plane of the 8 screen bytes at span; returns whether it turned a pixel off
+static inline byte drawSpan(byte* span, byte spriteByte, byte plane) {
+    uint64_t pixels = SPRITE_PIXELS[spriteByte] << plane;
+    uint64_t screen;
+    memcpy(&screen, span, sizeof(screen));
+    byte collision = (screen & pixels) != 0;
+    screen ^= pixels;
+    memcpy(span, &screen, sizeof(screen));
+    return collision;
+}
+#endif
+
+#define CORE_PASTE(name, quirks) name##_##quirks
+#define CORE_NAME(name, quirks) CORE_PASTE(name, quirks)
+#define CORE_FN(name) CORE_NAME(name, CORE_QUIRKS)
+#define QUIRK(name) (CORE_QUIRKS & QUIRK_##name)
+
+#endif
@@ -4,17 +4,54 @@
 
 static const byte SCREEN_X = 0x40;
 static const byte SCREEN_Y = 0x20;
+// SUPER-CHIP hires mode; the screen is always allocated at this size
+static const byte HIRES_X = 0x80;
+static const byte HIRES_Y = 0x40;
+// XO-CHIP bitplanes; a pixel value holds one bit per plane
+static const byte SCREEN_PLANES = 0x4;
 
 static const byte SCREEN_COEFF = 8;
-static const byte TICKS_PER_FRAME = 8;
+// Host frames per second: how often the emulated clock is advanced and the screen handed over
 static const byte FRAMES_PER_SECOND = 60;
+// DT and ST count down at this rate of emulated time, whatever the host frame rate
+static const byte TIMER_HZ = 60;
+// Instructions per second of emulated time unless a frontend is given --ips
+static const unsigned int DEFAULT_IPS = 480;
 
-static const byte LOGGING = 0;
+// Final stretch of each frame wait that is spun instead of slept, to hide the sleep's wake-up latency
+static const unsigned int PACER_SPIN_NS = 250000;
+// With vsync, the measured refresh period and the drift correction each move 1/REFRESH_SMOOTHING of
+// the way per frame; a present taking longer than REFRESH_STALL_FRAMES periods restarts the schedule
+static const byte REFRESH_SMOOTHING = 16;
+static const byte REFRESH_STALL_FRAMES = 8;
 
-// Quirks
-static const byte SHIFTING = 1;
-static const byte JUMPING = 0;
-static const byte VF_RESET = 1;
-static const byte MEMORY = 1;
-static const byte CLIPPING = 1;
+// Window pixels per screen pixel on the multi-instance wall
+static const byte WALL_TILE_SCALE = 2;
+
+// Intensity, out of 255, a pixel loses per frame after turning off when the phosphor filter is on
+static const byte PHOSPHOR_DECAY = 0x40;
+
+// Size of the ring between the emulating thread and the trace drain thread, a power of two
+static const unsigned int TRACE_BUFFER_BYTES = 1 << 20;
+
+// Longest loop body, in bytes, that the core checks for a DT or key polling idle loop
+static const byte IDLE_LOOP_BYTES = 16;
+
+// Executions of an address before the JIT core translates the block starting there
+static const byte JIT_THRESHOLD = 32;
+
+// Longest basic block, in instructions, the recompiler emits as one function
+static const byte AOT_MAX_BLOCK = 64;
+
+// Key events the frontend can queue for the emulation thread between two frames, a power of two
+static const byte INPUT_QUEUE_SIZE = 0x40;
+
+// Frames a key stays pressed in the terminal frontend, since terminals report presses but no releases
+static const byte TERM_KEY_FRAMES = 6;
+
+// Cxkk generator state after a reset, until a frontend picks another with seedChip
+static const unsigned int DEFAULT_SEED = 0x2545F491;
+
+// Quirk profile used until a ROM selects another one with setQuirks
+static const byte DEFAULT_QUIRKS = QUIRK_SHIFTING | QUIRK_VF_RESET | QUIRK_MEMORY | QUIRK_CLIPPING;
 #endif
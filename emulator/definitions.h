@@ -3,6 +3,16 @@
 typedef unsigned char byte;
 typedef unsigned short word;
 
+// Behaviour differences between CHIP-8 interpreters, combined into a per-ROM profile
+typedef enum chip8quirk {
+    QUIRK_SHIFTING = 1 << 0,
+    QUIRK_JUMPING = 1 << 1,
+    QUIRK_VF_RESET = 1 << 2,
+    QUIRK_MEMORY = 1 << 3,
+    QUIRK_CLIPPING = 1 << 4,
+    QUIRK_PROFILES = 1 << 5
+} chip8quirk;
+
 static const byte INTERPRETER_DIGITS_STUB[0x50] = {
     0x60, 0xA0, 0xA0, 0xA0, 0xC0, // 0
     0x40, 0xC0, 0x40, 0x40, 0xE0, // 1
@@ -21,4 +31,19 @@ static const byte INTERPRETER_DIGITS_STUB[0x50] = {
     0xE0, 0x80, 0xC0, 0x80, 0xE0, // E
     0xE0, 0x80, 0xC0, 0x80, 0x80, // F
 };
+
+// SUPER-CHIP 8x10 digits for Fx30, loaded right after the small ones
+static const byte BIG_DIGITS_ADDRESS = 0x50;
+static const byte BIG_DIGITS[0x64] = {
+    0x3C, 0x7E, 0xE7, 0xC3, 0xC3, 0xC3, 0xC3, 0xE7, 0x7E, 0x3C, // 0
+    0x18, 0x38, 0x58, 0x18, 0x18, 0x18, 0x18, 0x18, 0x18, 0x3C, // 1
+    0x3E, 0x7F, 0xC3, 0x06, 0x0C, 0x18, 0x30, 0x60, 0xFF, 0xFF, // 2
+    0x3C, 0x7E, 0xC3, 0x03, 0x0E, 0x0E, 0x03, 0xC3, 0x7E, 0x3C, // 3
+    0x06, 0x0E, 0x1E, 0x36, 0x66, 0xC6, 0xFF, 0xFF, 0x06, 0x06, // 4
+    0xFF, 0xFF, 0xC0, 0xC0, 0xFC, 0xFE, 0x03, 0xC3, 0x7E, 0x3C, // 5
+    0x3E, 0x7C, 0xE0, 0xC0, 0xFC, 0xFE, 0xC3, 0xC3, 0x7E, 0x3C, // 6
+    0xFF, 0xFF, 0x03, 0x06, 0x0C, 0x18, 0x30, 0x60, 0x60, 0x60, // 7
+    0x3C, 0x7E, 0xC3, 0xC3, 0x7E, 0x7E, 0xC3, 0xC3, 0x7E, 0x3C, // 8
+    0x3C, 0x7E, 0xC3, 0xC3, 0x7F, 0x3F, 0x03, 0x03, 0x3E, 0x7C, // 9
+};
 #endif
@@ -0,0 +1,64 @@
+// Microbenchmark: the SPRITE_PIXELS table draw against the pixel-by-pixel draw it replaced, on the
+// same random sprites (16x16 ones included), with clipping and with wrapping, in lores and hires,
+// into one plane and into two. Both must leave identical screens.
+//
+// usage: drawbench [sprites]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "chip8.h"
+#include "chip8ops.h"
+
+#define CORE_QUIRKS 29
+#define CORE_HANDLERS_ONLY
+#include "chip8core.inc"
+#define CORE_QUIRKS 0
+#include "chip8core.inc"
+
+typedef void (*drawFn)(chip8* chip, byte x, byte y, byte size);
+
+// Draws the same pseudo-random sprite sequence with fn; returns seconds taken, collisions in hits
+static double run(chip8* chip, drawFn fn, int sprites, unsigned long* hits) {
+    unsigned int seed = 1;
+    *hits = 0;
+    clock_t start = clock();
+    for (int i = 0; i < sprites; i++) {
+        seed = seed * 1103515245 + 12345;
+        chip->I = 0x200 + ((seed >> 8) & 0x1FF);
+        fn(chip, seed >> 16, seed >> 24, (seed >> 4) % 16);
+        *hits += chip->V[0xF];
+    }
+    return (double)(clock() - start) / CLOCKS_PER_SEC;
+}
+
+static int compare(const char* name, drawFn table, drawFn pixels, byte hires, byte planes, int sprites) {
+    chip8* a = createChip();
+    chip8* b = createChip();
+    a->hires = b->hires = hires;
+    a->planes = b->planes = planes;
+    for (int i = 0x200; i < 0x1000; i++) {
+        a->memory[i] = b->memory[i] = rand();
+    }
+    unsigned long tableHits, pixelHits;
+    double tableTime = run(a, table, sprites, &tableHits);
+    double pixelTime = run(b, pixels, sprites, &pixelHits);
+    int same = tableHits == pixelHits && memcmp(a->screen, b->screen, sizeof(a->screen)) == 0;
+    printf("%-15s table %.3fs  pixels %.3fs  speedup %.2fx  %s\n", name, tableTime, pixelTime,
+           tableTime > 0 ? pixelTime / tableTime : 0, same ? "identical" : "MISMATCH");
+    destroyChip(a);
+    destroyChip(b);
+    return same;
+}
+
+int main(int argc, char* argv[]) {
+    int sprites = argc > 1 ? atoi(argv[1]) : 10000000;
+    int same = compare("clipping", draw_29, drawPixels_29, 0, 0x1, sprites);
+    same &= compare("wrapping", draw_0, drawPixels_0, 0, 0x1, sprites);
+    same &= compare("hires clipping", draw_29, drawPixels_29, 1, 0x1, sprites);
+    same &= compare("hires wrapping", draw_0, drawPixels_0, 1, 0x1, sprites);
+    same &= compare("two planes", draw_0, drawPixels_0, 1, 0x3, sprites);
+    return same ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,316 @@
+#include "emulation.h"
+
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "config.h"
+#include "utils.h"
+#include "vip.h"
+
+frame* backFrame(tripleBuffer* buffer) {
+    return &buffer->frames[buffer->back];
+}
+
+void publishFrame(tripleBuffer* buffer) {
+    byte previous = atomic_exchange_explicit(&buffer->middle, buffer->back | FRAME_FRESH, memory_order_acq_rel);
+    buffer->back = previous & ~FRAME_FRESH;
+}
+
+// Newest frame published since the last call, or NULL if there is none
+const frame* takeFrame(tripleBuffer* buffer) {
+    if (!(atomic_load_explicit(&buffer->middle, memory_order_relaxed) & FRAME_FRESH)) {
+        return NULL;
+    }
+    byte previous = atomic_exchange_explicit(&buffer->middle, buffer->front, memory_order_acq_rel);
+    buffer->front = previous & ~FRAME_FRESH;
+    return &buffer->frames[buffer->front];
+}
+
+// Returns 0 and drops the event when the queue is full
+byte pushInput(inputQueue* queue, inputEvent event) {
+    unsigned int head = atomic_load_explicit(&queue->head, memory_order_relaxed);
+    if (head - atomic_load_explicit(&queue->tail, memory_order_acquire) == INPUT_QUEUE_SIZE) {
+        return 0;
+    }
+    queue->events[head & (INPUT_QUEUE_SIZE - 1)] = event;
+    atomic_store_explicit(&queue->head, head + 1, memory_order_release);
+    return 1;
+}
+
+byte popInput(inputQueue* queue, inputEvent* event) {
+    unsigned int tail = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+    if (tail == atomic_load_explicit(&queue->head, memory_order_acquire)) {
+        return 0;
+    }
+    *event = queue->events[tail & (INPUT_QUEUE_SIZE - 1)];
+    atomic_store_explicit(&queue->tail, tail + 1, memory_order_release);
+    return 1;
+}
+
+static void scheduleTick(chip8clock* clock) {
+    long long due = (long long)clock->ips - (long long)clock->tickOvershoot;
+    clock->untilTick = due > 0 ? (due + TIMER_HZ - 1) / TIMER_HZ : 0;
+    clock->tickOvershoot = clock->untilTick * TIMER_HZ - due;
+}
+
+// Under TIMING_VIP the rate is VIP_CYCLES_PER_SECOND machine cycles, whatever ips says
+void startClock(chip8clock* clock, const chip8* chip, unsigned long long ips) {
+    clock->ips = chip->timing == TIMING_VIP ? VIP_CYCLES_PER_SECOND : ips ? ips : DEFAULT_IPS;
+    clock->pending = 0;
+    clock->overrun = 0;
+    clock->tickOvershoot = 0;
+    scheduleTick(clock);
+}
+
+static void reportUnknown(chip8* chip) {
+    word address = (chip->PC - 2) & chip->memoryMask;
+    printf("Address: %04X\nOpcode: %04X\n\n", address, parseWord(readMemory(chip, address), readMemory(chip, address + 1)));
+}
+
+// A core that stops early because it is idle or waiting for a key gives up the rest of its batch,
+// since nothing changes before the next timer tick or key event
+static void runInstructions(chip8* chip, unsigned long long count) {
+    while (count > 0) {
+        int budget = count < INT_MAX ? count : INT_MAX;
+        unsigned long long retired = chip->instructions;
+        chip8stop stop = runCycles(chip, budget);
+        unsigned long long ran = chip->instructions - retired;
+        if (stop == STOP_UNKNOWN) {
+            reportUnknown(chip);
+        } else if (stop != STOP_DRAW && stop != STOP_BUDGET) {
+            ran = count;
+        }
+        count -= ran;
+    }
+}
+
+// The same for machine cycles under TIMING_VIP, where a DRW waiting for the vertical blank gives up
+// the batch too. An instruction that runs past the end of one batch is paid for from the next.
+static void runMachineCycles(chip8clock* clock, chip8* chip, unsigned long long count) {
+    long long left = (long long)count - clock->overrun;
+    while (left > 0) {
+        long long spent;
+        chip8stop stop = runVip(chip, left, &spent);
+        if (stop == STOP_UNKNOWN) {
+            reportUnknown(chip);
+        } else if (stop != STOP_BUDGET) {
+            spent = left;
+        }
+        left -= spent;
+    }
+    clock->overrun = -left;
+}
+
+// Runs the instructions and timer ticks that fall in the next nanoseconds of emulated time, in
+// batches that end at a timer tick
+void runClock(chip8clock* clock, chip8* chip, long long nanoseconds) {
+    clock->pending += nanoseconds * clock->ips;
+    unsigned long long owed = clock->pending / 1000000000ULL;
+    clock->pending %= 1000000000ULL;
+    while (owed > 0 || clock->untilTick == 0) {
+        unsigned long long batch = owed < clock->untilTick ? owed : clock->untilTick;
+        if (chip->timing == TIMING_VIP) {
+            runMachineCycles(clock, chip, batch);
+        } else {
+            runInstructions(chip, batch);
+        }
+        owed -= batch;
+        clock->untilTick -= batch;
+        if (clock->untilTick == 0) {
+            updateTimers(chip);
+            if (chip->timing == TIMING_VIP) {
+                clock->overrun += vipVblank(chip);
+            }
+            scheduleTick(clock);
+        }
+    }
+}
+
+// Command line names shared by the frontends
+chip8core parseCore(const char* name) {
+    if (strcmp(name, "table") == 0) {
+        return CORE_TABLE;
+    }
+    if (strcmp(name, "threaded") == 0) {
+        return CORE_THREADED;
+    }
+    if (strcmp(name, "jit") == 0) {
+        return CORE_JIT;
+    }
+    return CORE_SWITCH;
+}
+
+chip8timing parseTiming(const char* name) {
+    return strcmp(name, "vip") == 0 ? TIMING_VIP : TIMING_INSTRUCTIONS;
+}
+
+// Named quirk profiles, or a hexadecimal chip8quirk mask
+byte parseQuirks(const char* name) {
+    if (strcmp(name, "chip8") == 0) {
+        return DEFAULT_QUIRKS;
+    }
+    if (strcmp(name, "schip") == 0) {
+        return QUIRK_JUMPING | QUIRK_CLIPPING;
+    }
+    if (strcmp(name, "xochip") == 0) {
+        return QUIRK_SHIFTING | QUIRK_MEMORY;
+    }
+    return (byte)strtol(name, NULL, 16);
+}
+
+static void applyEvent(chip8* chip, inputEvent event) {
+    // keysNow holds the releases since the previous event, so Fx0A sees each one in order
+    memset(chip->keysNow, 0, sizeof(chip->keysNow));
+    if (event.pressed) {
+        chip->keys[event.key] = 0x1;
+    } else {
+        chip->keysNow[event.key] = 0x1;
+        chip->keys[event.key] = 0x0;
+    }
+}
+
+// Runs emulated nanoseconds with the events queued since the last call applied at the instruction
+// boundaries matching when they happened in that host time, so their order and spacing within a
+// frame survive
+static void runWithInput(emulation* emu, long long emulated) {
+    chip8* chip = emu->chip;
+    memset(chip->keysNow, 0, sizeof(chip->keysNow));
+    long long start = emu->inputTime;
+    long long span = monotonicNanoseconds() - start;
+    emu->inputTime = start + span;
+    long long done = 0;
+    inputEvent event;
+    while (popInput(&emu->input, &event)) {
+        long long offset = event.time - start;
+        offset = offset < 0 ? 0 : offset > span ? span : offset;
+        long long at = span > 0 ? (long long)((double)offset / span * emulated) : 0;
+        if (at > done) {
+            runClock(&emu->clock, chip, at - done);
+            done = at;
+        }
+        applyEvent(chip, event);
+    }
+    runClock(&emu->clock, chip, emulated - done);
+}
+
+static void publishScreen(emulation* emu, uint64_t dirtyRows) {
+    frame* next = backFrame(&emu->frames);
+    memcpy(next->screen, emu->chip->screen, sizeof(next->screen));
+    next->hires = emu->chip->hires;
+    next->dirtyRows = dirtyRows;
+    next->sequence = ++emu->sequence;
+    publishFrame(&emu->frames);
+}
+
+// Publishes the screen as it will be runAhead frames from now if the input stays as it is, then
+// puts the machine back. The frame that answers a key press is on screen that many frames sooner.
+// The presented screen differs from the real one in the rows the look ahead changed, so those are
+// redrawn for this frame and again for the next.
+static void publishAhead(emulation* emu, byte runAhead, long long nanoseconds) {
+    chip8* chip = emu->chip;
+    uint64_t rows = takeDirtyRows(chip);
+    unsigned int generation = chip->screenGeneration;
+    chip8clock clock = emu->clock;
+    saveChip(chip, &emu->snapshot);
+    // Releases were seen by the real frame already
+    memset(chip->keysNow, 0, sizeof(chip->keysNow));
+    for (byte ahead = 0; ahead < runAhead; ahead++) {
+        runClock(&emu->clock, chip, nanoseconds);
+    }
+    uint64_t aheadRows = takeDirtyRows(chip);
+    if (generation != emu->generation || chip->screenGeneration != generation || emu->aheadRows) {
+        publishScreen(emu, rows | aheadRows | emu->aheadRows);
+    }
+    emu->generation = generation;
+    emu->aheadRows = aheadRows;
+    restoreChip(chip, &emu->snapshot);
+    emu->clock = clock;
+}
+
+// One host frame: nanoseconds of emulated time times the speed, with the input queued so far. Faster
+// than real time a host frame covers several emulated ones and still publishes at most once, so
+// the skipped frames never reach the frontend; a frame is published only when the screen changed.
+void stepEmulation(emulation* emu, long long nanoseconds) {
+    unsigned int speed = atomic_load_explicit(&emu->speed, memory_order_relaxed);
+    if (speed == 0) {
+        // Unlimited: emulate frames for most of this host frame, leaving the rest for presenting
+        long long end = monotonicNanoseconds() + nanoseconds - nanoseconds / 4;
+        runWithInput(emu, nanoseconds);
+        while (monotonicNanoseconds() < end) {
+            runClock(&emu->clock, emu->chip, nanoseconds);
+        }
+    } else {
+        runWithInput(emu, nanoseconds * speed);
+    }
+    // Not while fast-forwarding, nor while tracing, which would record the instructions run ahead
+    byte runAhead = atomic_load_explicit(&emu->runAhead, memory_order_relaxed);
+    if (runAhead && speed == 1 && emu->chip->trace == NULL) {
+        publishAhead(emu, runAhead, nanoseconds);
+    } else if (emu->chip->screenGeneration != emu->generation || emu->aheadRows) {
+        emu->generation = emu->chip->screenGeneration;
+        publishScreen(emu, takeDirtyRows(emu->chip) | emu->aheadRows);
+        emu->aheadRows = 0;
+    }
+}
+
+// Runs host frames against the monotonic clock until stopEmulation
+static void* emulationThread(void* argument) {
+    emulation* emu = argument;
+    startPacer(&emu->pace, 1000000000LL / FRAMES_PER_SECOND);
+    while (atomic_load_explicit(&emu->running, memory_order_acquire)) {
+        stepEmulation(emu, emu->pace.period);
+        if (atomic_load_explicit(&emu->speed, memory_order_relaxed) == 0) {
+            resyncPacer(&emu->pace);
+        } else {
+            waitPacer(&emu->pace);
+        }
+    }
+    return NULL;
+}
+
+// Sets up emulation for a frontend that calls stepEmulation itself; ips of 0 runs at DEFAULT_IPS
+void initEmulation(emulation* emu, chip8* chip, unsigned long long ips) {
+    memset(emu, 0, sizeof(emulation));
+    emu->chip = chip;
+    startClock(&emu->clock, chip, ips);
+    emu->frames.back = 0;
+    emu->frames.front = 1;
+    atomic_init(&emu->frames.middle, 2);
+    atomic_init(&emu->input.head, 0);
+    atomic_init(&emu->input.tail, 0);
+    atomic_init(&emu->running, 0);
+    atomic_init(&emu->speed, 1);
+    atomic_init(&emu->runAhead, 0);
+    emu->generation = chip->screenGeneration;
+    emu->inputTime = monotonicNanoseconds();
+    markScreenDirty(chip);
+}
+
+// Runs emulation on its own thread
+chip8result startEmulation(emulation* emu, chip8* chip, unsigned long long ips) {
+    initEmulation(emu, chip, ips);
+    atomic_store_explicit(&emu->running, 1, memory_order_relaxed);
+    if (pthread_create(&emu->thread, NULL, emulationThread, emu) != 0) {
+        atomic_store_explicit(&emu->running, 0, memory_order_relaxed);
+        return ERROR;
+    }
+    return SUCCESS;
+}
+
+// Joins the emulation thread, if startEmulation started one
+void stopEmulation(emulation* emu) {
+    if (atomic_exchange_explicit(&emu->running, 0, memory_order_acq_rel)) {
+        pthread_join(emu->thread, NULL);
+    }
+}
+
+void setEmulationSpeed(emulation* emu, unsigned int speed) {
+    atomic_store_explicit(&emu->speed, speed, memory_order_relaxed);
+}
+
+// Frames to look ahead before publishing, 0 to publish the real screen
+void setRunAhead(emulation* emu, byte frames) {
+    atomic_store_explicit(&emu->runAhead, frames, memory_order_relaxed);
+}
@@ -0,0 +1,102 @@
+#ifndef EMULATION_H
+#define EMULATION_H
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+
+#include "chip8.h"
+#include "pacer.h"
+
+// A completed screen handed from the emulation thread to the frontend
+typedef struct frame {
+    chip8screen screen;
+    byte hires;
+    // Rows changed since the previously published frame
+    uint64_t dirtyRows;
+    // Consecutive per published frame, so the frontend can tell it skipped one
+    unsigned int sequence;
+} frame;
+
+// Set in tripleBuffer.middle while the frame there has not been taken yet
+#define FRAME_FRESH 0x4
+
+// The producer fills back and swaps it with middle; the consumer swaps front with a fresh middle.
+// Neither side waits for the other and the consumer always gets the newest frame.
+typedef struct tripleBuffer {
+    frame frames[3];
+    _Atomic byte middle;
+    byte back;
+    byte front;
+} tripleBuffer;
+
+typedef struct inputEvent {
+    byte key;
+    byte pressed;
+    // When it happened, on the monotonic clock
+    long long time;
+} inputEvent;
+
+// Key events from the frontend thread to the emulation thread
+typedef struct inputQueue {
+    inputEvent events[INPUT_QUEUE_SIZE];
+    _Atomic unsigned int head;
+    _Atomic unsigned int tail;
+} inputQueue;
+
+// Emulated time: instructions run at ips per second and the timers tick at TIMER_HZ of that time.
+// Under TIMING_VIP ips counts machine cycles instead.
+// Host time is converted into instructions through a fractional accumulator, so no rate is
+// rounded to a whole number of instructions per frame or per tick.
+typedef struct chip8clock {
+    unsigned long long ips;
+    // Host nanoseconds times ips not yet worth a whole instruction
+    unsigned long long pending;
+    // Instructions left before the next timer tick
+    unsigned long long untilTick;
+    // How far past its exact time the last tick fell, in 1/TIMER_HZ instructions, since ticks land
+    // on the first instruction boundary at or after it
+    unsigned long long tickOvershoot;
+    // Machine cycles the last instruction ran past its batch, or the display took, under TIMING_VIP
+    long long overrun;
+} chip8clock;
+
+typedef struct emulation {
+    chip8* chip;
+    chip8clock clock;
+    tripleBuffer frames;
+    inputQueue input;
+    _Atomic byte running;
+    // Emulated frames per host frame, 0 for as many as the host can run
+    _Atomic unsigned int speed;
+    pthread_t thread;
+    // Owned by the emulation thread; read its jitter only after stopEmulation
+    pacer pace;
+    // Screen generation last published, and the sequence number it went out with
+    unsigned int generation;
+    unsigned int sequence;
+    // Host time the input applied so far reaches up to
+    long long inputTime;
+    _Atomic byte runAhead;
+    // Rows where the last published screen, run ahead, differs from the real one
+    uint64_t aheadRows;
+    chip8snapshot snapshot;
+} emulation;
+
+frame* backFrame(tripleBuffer* buffer);
+void publishFrame(tripleBuffer* buffer);
+const frame* takeFrame(tripleBuffer* buffer);
+byte pushInput(inputQueue* queue, inputEvent event);
+byte popInput(inputQueue* queue, inputEvent* event);
+void startClock(chip8clock* clock, const chip8* chip, unsigned long long ips);
+void runClock(chip8clock* clock, chip8* chip, long long nanoseconds);
+chip8core parseCore(const char* name);
+byte parseQuirks(const char* name);
+chip8timing parseTiming(const char* name);
+void initEmulation(emulation* emu, chip8* chip, unsigned long long ips);
+void stepEmulation(emulation* emu, long long nanoseconds);
+chip8result startEmulation(emulation* emu, chip8* chip, unsigned long long ips);
+void stopEmulation(emulation* emu);
+void setEmulationSpeed(emulation* emu, unsigned int speed);
+void setRunAhead(emulation* emu, byte frames);
+
+#endif
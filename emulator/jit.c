@@ -0,0 +1,636 @@
+#include "jit.h"
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "config.h"
+
+// Translated blocks keep V, I and PC in host registers: the prologue loads the V registers a block
+// touches into the ten it can allocate, I into r15d and the chip pointer into rbx, and the epilogue,
+// the one way out of a block, writes back what changed along with PC from r14d. A block that would
+// need an eleventh V register ends before that instruction. Between blocks the chip struct is
+// complete, so the interpreter can take over at any block boundary.
+
+#if defined(__x86_64__) || defined(_M_X64)
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif
+
+#define JIT_BUFFER_SIZE 0x40000
+#define JIT_MAX_BLOCK 32
+// Worst case bytes emitted for one instruction, and for the prologue and epilogue around a block
+#define JIT_MAX_INSTRUCTION 64
+#define JIT_MAX_FRAME 256
+
+typedef struct emitter {
+    byte* code;
+    unsigned int size;
+} emitter;
+
+static void emit(emitter* e, byte value) {
+    e->code[e->size++] = value;
+}
+
+static void emit16(emitter* e, word value) {
+    emit(e, value & 0xFF);
+    emit(e, value >> 8);
+}
+
+static void emit32(emitter* e, unsigned int value) {
+    emit16(e, value & 0xFFFF);
+    emit16(e, value >> 16);
+}
+
+// opcode followed by a ModRM addressing [rbx + disp32]
+static void emitRbx(emitter* e, byte op, byte reg, unsigned int offset) {
+    emit(e, op);
+    emit(e, 0x80 | ((reg & 7) << 3) | 0x3);
+    emit32(e, offset);
+}
+
+static void emitRbx2(emitter* e, byte prefix, byte op, byte reg, unsigned int offset) {
+    emit(e, prefix);
+    emitRbx(e, op, reg, offset);
+}
+
+#define REG_AX 0
+#define REG_CX 1
+#define REG_DX 2
+#define REG_BX 3
+#define REG_BP 5
+#define REG_SI 6
+#define REG_DI 7
+#define REG_R8 8
+#define REG_R12 12
+#define REG_R13 13
+#define REG_R14 14
+#define REG_R15 15
+
+// Blocks keep PC in r14d and I in r15d, zero-extended
+#define REG_PC REG_R14
+#define REG_I REG_R15
+
+// Host registers V is allocated to, caller-saved ones first. Each takes a byte register, so ah to bh
+// are never used and a REX prefix always selects sil, dil and bpl rather than them.
+static const byte V_HOSTS[] = { REG_DX, REG_R8, REG_R8 + 1, REG_R8 + 2, REG_R8 + 3, REG_SI, REG_DI, REG_BP, REG_R12, REG_R13 };
+
+// Which host register each V is in for the block being translated, and what the block touches
+typedef struct registers {
+    signed char host[0x10];
+    byte count;
+    word written;
+    byte usesI;
+    byte writesI;
+} registers;
+
+// The host register holding V[x], allocated on first use; -1 when the block has run out of them
+static int operand(registers* r, byte x, byte written) {
+    if (r->host[x] < 0) {
+        if (r->count == sizeof(V_HOSTS)) {
+            return -1;
+        }
+        r->host[x] = V_HOSTS[r->count++];
+    }
+    r->written |= written << x;
+    return r->host[x];
+}
+
+static void emitRex(emitter* e, byte wide, byte reg, byte rm) {
+    emit(e, 0x40 | (wide << 3) | ((reg >> 3) << 2) | (rm >> 3));
+}
+
+// op with ModRM selecting two registers, reg and rm; byte operations always carry a REX prefix
+static void emitRegs(emitter* e, byte op, byte reg, byte rm) {
+    emitRex(e, 0, reg, rm);
+    emit(e, op);
+    emit(e, 0xC0 | ((reg & 7) << 3) | (rm & 7));
+}
+
+// op with ModRM addressing [rbx + disp32], for any of the sixteen registers
+static void emitRbxRex(emitter* e, byte op, byte reg, unsigned int offset) {
+    emitRex(e, 0, reg, 0);
+    emitRbx(e, op, reg, offset);
+}
+
+static void emitMovImm8(emitter* e, byte reg, byte value) {  // mov r8, imm8
+    emitRex(e, 0, 0, reg);
+    emit(e, 0xB0 | (reg & 7));
+    emit(e, value);
+}
+
+static void emitMovImm32(emitter* e, byte reg, unsigned int value) { // mov r32, imm32
+    emitRex(e, 0, 0, reg);
+    emit(e, 0xB8 | (reg & 7));
+    emit32(e, value);
+}
+
+static void emitImm8(emitter* e, byte digit, byte reg, byte value) { // add/cmp r8, imm8
+    emitRex(e, 0, 0, reg);
+    emit(e, 0x80);
+    emit(e, 0xC0 | (digit << 3) | (reg & 7));
+    emit(e, value);
+}
+
+static void emitMovzx(emitter* e, byte reg, byte rm) {       // movzx r32, r8
+    emitRex(e, 0, reg, rm);
+    emit(e, 0x0F);
+    emit(e, 0xB6);
+    emit(e, 0xC0 | ((reg & 7) << 3) | (rm & 7));
+}
+
+static void emitSet(emitter* e, byte setcc, byte rm) {       // setcc r8
+    emitRex(e, 0, 0, rm);
+    emit(e, 0x0F);
+    emit(e, setcc);
+    emit(e, 0xC0 | (rm & 7));
+}
+
+static void emitStorePC(emitter* e, word value) {
+    emitMovImm32(e, REG_PC, value);
+}
+
+static void emitPush(emitter* e, byte reg) {
+    if (reg >= 8) {
+        emit(e, 0x41);
+    }
+    emit(e, 0x50 | (reg & 7));
+}
+
+static void emitPop(emitter* e, byte reg) {
+    if (reg >= 8) {
+        emit(e, 0x41);
+    }
+    emit(e, 0x58 | (reg & 7));
+}
+
+#define OFFSET_V(r) (offsetof(chip8, V) + (r))
+#define OFFSET_I offsetof(chip8, I)
+#define OFFSET_PC offsetof(chip8, PC)
+#define OFFSET_SP offsetof(chip8, SP)
+#define OFFSET_DT offsetof(chip8, DT)
+#define OFFSET_ST offsetof(chip8, ST)
+#define OFFSET_STACK offsetof(chip8, stack)
+#define OFFSET_KEYS offsetof(chip8, keys)
+
+// Skip instructions: the next PC is the fall-through unless the jcc jumps over the skip store
+static void emitSkip(emitter* e, byte jcc, word skipTo) {
+    emit(e, jcc);
+    emit(e, 0);
+    unsigned int from = e->size;
+    emitStorePC(e, skipTo);
+    e->code[from - 1] = e->size - from;
+}
+
+#define SETC 0x92
+#define SETNC 0x93
+#define JE 0x74
+#define JNE 0x75
+
+// Emits one instruction; returns 0 when it must be left to the interpreter or needs a V register the
+// block has none left for
+static int translate(emitter* e, registers* r, const decoded* d, byte quirks, word memoryMask) {
+    int vx, vy, vf;
+    switch (d->op) {
+        case OP_SYS:
+            return 1;
+        case OP_LD_BYTE:
+            if ((vx = operand(r, d->x, 1)) < 0) {
+                return 0;
+            }
+            emitMovImm8(e, vx, d->nn);
+            return 1;
+        case OP_ADD_BYTE:
+            if ((vx = operand(r, d->x, 1)) < 0) {
+                return 0;
+            }
+            emitImm8(e, 0, vx, d->nn);
+            return 1;
+        case OP_LD_REG:
+            if ((vy = operand(r, d->y, 0)) < 0 || (vx = operand(r, d->x, 1)) < 0) {
+                return 0;
+            }
+            emitRegs(e, 0x88, vy, vx);                        // mov vx, vy
+            return 1;
+        case OP_OR:
+        case OP_AND:
+        case OP_XOR:
+            if ((vy = operand(r, d->y, 0)) < 0 || (vx = operand(r, d->x, 1)) < 0) {
+                return 0;
+            }
+            emitRegs(e, d->op == OP_OR ? 0x08 : d->op == OP_AND ? 0x20 : 0x30, vy, vx);
+            if (quirks & QUIRK_VF_RESET) {
+                if ((vf = operand(r, 0xF, 1)) < 0) {
+                    return 0;
+                }
+                emitMovImm8(e, vf, 0);
+            }
+            return 1;
+        case OP_ADD_REG:
+        case OP_SUB:
+            if ((vy = operand(r, d->y, 0)) < 0 || (vx = operand(r, d->x, 1)) < 0 || (vf = operand(r, 0xF, 1)) < 0) {
+                return 0;
+            }
+            emitRegs(e, d->op == OP_ADD_REG ? 0x00 : 0x28, vy, vx);
+            emitSet(e, d->op == OP_ADD_REG ? SETC : SETNC, vf);
+            return 1;
+        case OP_SUBN:
+            if ((vy = operand(r, d->y, 0)) < 0 || (vx = operand(r, d->x, 1)) < 0 || (vf = operand(r, 0xF, 1)) < 0) {
+                return 0;
+            }
+            emitRegs(e, 0x8A, REG_AX, vy);                    // mov al, vy
+            emitRegs(e, 0x2A, REG_AX, vx);                    // sub al, vx
+            emitRegs(e, 0x88, REG_AX, vx);                    // mov vx, al
+            emitSet(e, SETNC, vf);
+            return 1;
+        case OP_SHR:
+        case OP_SHL:
+            if ((vy = operand(r, quirks & QUIRK_SHIFTING ? d->y : d->x, 0)) < 0 || (vx = operand(r, d->x, 1)) < 0 ||
+                (vf = operand(r, 0xF, 1)) < 0) {
+                return 0;
+            }
+            emitRegs(e, 0x8A, REG_AX, vy);                    // mov al, source
+            emit(e, 0xD0);                                    // shr/shl al, 1
+            emit(e, d->op == OP_SHR ? 0xE8 : 0xE0);
+            emitRegs(e, 0x88, REG_AX, vx);
+            emitSet(e, SETC, vf);
+            return 1;
+        case OP_LD_I:
+            r->usesI = r->writesI = 1;
+            emitMovImm32(e, REG_I, d->nnn);
+            return 1;
+        case OP_ADD_I:
+            if ((vx = operand(r, d->x, 0)) < 0) {
+                return 0;
+            }
+            r->usesI = r->writesI = 1;
+            emitMovzx(e, REG_AX, vx);
+            emitRegs(e, 0x03, REG_AX, REG_I);                 // add eax, r15d
+            emit(e, 0x25);                                    // and eax, memoryMask
+            emit32(e, memoryMask);
+            emitRegs(e, 0x89, REG_AX, REG_I);                 // mov r15d, eax
+            return 1;
+        case OP_LD_F:
+            if ((vx = operand(r, d->x, 0)) < 0) {
+                return 0;
+            }
+            r->usesI = r->writesI = 1;
+            emitMovzx(e, REG_AX, vx);
+            emit(e, 0x25);                                    // and eax, 0xF
+            emit32(e, 0xF);
+            emit(e, 0x8D);                                    // lea eax, [rax + rax * 4]
+            emit(e, 0x04);
+            emit(e, 0x80);
+            emitRegs(e, 0x89, REG_AX, REG_I);
+            return 1;
+        case OP_LD_VX_DT:
+            if ((vx = operand(r, d->x, 1)) < 0) {
+                return 0;
+            }
+            emitRbxRex(e, 0x8A, vx, OFFSET_DT);               // mov vx, byte [DT]
+            return 1;
+        case OP_LD_DT_VX:
+        case OP_LD_ST_VX:
+            if ((vx = operand(r, d->x, 0)) < 0) {
+                return 0;
+            }
+            emitMovzx(e, REG_AX, vx);
+            emitRbx2(e, 0x66, 0x89, REG_AX, d->op == OP_LD_DT_VX ? OFFSET_DT : OFFSET_ST);
+            return 1;
+        default:
+            return 0;
+    }
+}
+
+// Emits a block-ending instruction; returns 0 if d does not end a block or needs a V register the
+// block has none left for. A taken skip goes to skipTo.
+static int translateExit(emitter* e, registers* r, const decoded* d, word next, word skipTo, byte quirks) {
+    int vx, vy;
+    switch (d->op) {
+        case OP_JP:
+            emitStorePC(e, d->nnn);
+            return 1;
+        case OP_CALL:
+            emit(e, 0x0F);                                    // movzx eax, word [SP]
+            emitRbx(e, 0xB7, REG_AX, OFFSET_SP);
+            emit(e, 0xFF);                                    // inc eax
+            emit(e, 0xC0);
+            emit(e, 0x25);                                    // and eax, 0xF
+            emit32(e, 0xF);
+            emitRbx2(e, 0x66, 0x89, REG_AX, OFFSET_SP);
+            emit(e, 0x66);                                    // mov word [stack + rax * 2], next
+            emit(e, 0xC7);
+            emit(e, 0x84);
+            emit(e, 0x43);
+            emit32(e, OFFSET_STACK);
+            emit16(e, next);
+            emitStorePC(e, d->nnn);
+            return 1;
+        case OP_RET:
+            emit(e, 0x0F);                                    // movzx eax, word [SP]
+            emitRbx(e, 0xB7, REG_AX, OFFSET_SP);
+            emit(e, 0x0F);                                    // movzx ecx, word [stack + rax * 2]
+            emit(e, 0xB7);
+            emit(e, 0x8C);
+            emit(e, 0x43);
+            emit32(e, OFFSET_STACK);
+            emitRegs(e, 0x89, REG_CX, REG_PC);                // mov r14d, ecx
+            emit(e, 0xFF);                                    // dec eax
+            emit(e, 0xC8);
+            emit(e, 0x25);                                    // and eax, 0xF
+            emit32(e, 0xF);
+            emitRbx2(e, 0x66, 0x89, REG_AX, OFFSET_SP);
+            return 1;
+        case OP_JP_V0:
+            if ((vx = operand(r, quirks & QUIRK_JUMPING ? d->x : 0x0, 0)) < 0) {
+                return 0;
+            }
+            emitMovzx(e, REG_AX, vx);
+            emit(e, 0x05);                                    // add eax, nnn
+            emit32(e, d->nnn);
+            emitRegs(e, 0x89, REG_AX, REG_PC);                // mov r14d, eax
+            return 1;
+        case OP_SE_BYTE:
+        case OP_SNE_BYTE:
+            if ((vx = operand(r, d->x, 0)) < 0) {
+                return 0;
+            }
+            emitStorePC(e, next);
+            emitImm8(e, 7, vx, d->nn);                        // cmp vx, nn
+            emitSkip(e, d->op == OP_SE_BYTE ? JNE : JE, skipTo);
+            return 1;
+        case OP_SE_REG:
+        case OP_SNE_REG:
+            if ((vy = operand(r, d->y, 0)) < 0 || (vx = operand(r, d->x, 0)) < 0) {
+                return 0;
+            }
+            emitStorePC(e, next);
+            emitRegs(e, 0x38, vy, vx);                        // cmp vx, vy
+            emitSkip(e, d->op == OP_SE_REG ? JNE : JE, skipTo);
+            return 1;
+        case OP_SKP:
+        case OP_SKNP:
+            if ((vx = operand(r, d->x, 0)) < 0) {
+                return 0;
+            }
+            emitStorePC(e, next);
+            emitMovzx(e, REG_AX, vx);
+            emit(e, 0x25);                                    // and eax, 0xF
+            emit32(e, 0xF);
+            emit(e, 0x80);                                    // cmp byte [keys + rax], 1 / 0
+            emit(e, 0xBC);
+            emit(e, 0x03);
+            emit32(e, OFFSET_KEYS);
+            emit(e, d->op == OP_SKP ? 1 : 0);
+            emitSkip(e, JNE, skipTo);
+            return 1;
+        default:
+            return 0;
+    }
+}
+
+static void protect(jitState* jit, int writable) {
+#ifdef _WIN32
+    DWORD old;
+    VirtualProtect(jit->buffer, JIT_BUFFER_SIZE, writable ? PAGE_READWRITE : PAGE_EXECUTE_READ, &old);
+#else
+    mprotect(jit->buffer, JIT_BUFFER_SIZE, writable ? PROT_READ | PROT_WRITE : PROT_READ | PROT_EXEC);
+#endif
+}
+
+static jitState* jitCreate() {
+    jitState* jit = calloc(1, sizeof(jitState));
+    if (jit == NULL) {
+        return NULL;
+    }
+#ifdef _WIN32
+    jit->buffer = VirtualAlloc(NULL, JIT_BUFFER_SIZE, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+#else
+    jit->buffer = mmap(NULL, JIT_BUFFER_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (jit->buffer == MAP_FAILED) {
+        jit->buffer = NULL;
+    }
+#endif
+    if (jit->buffer == NULL) {
+        free(jit);
+        return NULL;
+    }
+    return jit;
+}
+
+// Callee-saved registers the block uses: rbx for the chip, r14 for PC, and whatever else it allocated
+static byte savedRegisters(const registers* r, byte* saved) {
+    byte count = 0;
+    saved[count++] = REG_BX;
+    saved[count++] = REG_PC;
+    if (r->usesI) {
+        saved[count++] = REG_I;
+    }
+    for (byte i = 0; i < r->count; i++) {
+        byte host = V_HOSTS[i];
+#ifdef _WIN32
+        byte calleeSaved = host == REG_SI || host == REG_DI || host == REG_BP || host >= REG_R12;
+#else
+        byte calleeSaved = host == REG_BP || host >= REG_R12;
+#endif
+        if (calleeSaved) {
+            saved[count++] = host;
+        }
+    }
+    return count;
+}
+
+static void compile(jitState* jit, chip8* chip, word start) {
+    jitEntry* entry = &jit->entries[start];
+    if (jit->used + JIT_MAX_BLOCK * JIT_MAX_INSTRUCTION + JIT_MAX_FRAME > JIT_BUFFER_SIZE) {
+        jitFlush(jit);
+    }
+
+    // The body goes first, into a scratch buffer: the prologue depends on the registers it allocated.
+    // Its only jumps are the short ones over skip stores, so it can be copied anywhere.
+    byte body[JIT_MAX_BLOCK * JIT_MAX_INSTRUCTION];
+    emitter e = { body, 0 };
+    registers r = { .count = 0 };
+    memset(r.host, -1, sizeof(r.host));
+
+    word address = start;
+    word end = start;
+    byte length = 0;
+    byte closed = 0;
+    while (!closed && length < JIT_MAX_BLOCK && address < 0x0FFE) {
+        decoded* d = &chip->cache[address];
+        if (d->op == OP_UNDECODED) {
+            decodeInstruction(chip, address, d);
+        }
+        word next = address + 2;
+        if (d->op == OP_JP && isIdleLoop(chip, address, d)) {
+            // Left to the interpreter so the idle loop is still reported
+            break;
+        }
+        // Skips step over all of an XO-CHIP F000 nnnn, so the block depends on the word after them
+        byte skipsLong = chip->memory[next] == 0xF0 && chip->memory[next + 1] == 0x00;
+        emitter before = e;
+        registers allocated = r;
+        if (translateExit(&e, &r, d, next, next + (skipsLong ? 4 : 2), chip->quirks)) {
+            closed = 1;
+            end = next + 2;
+        } else if (!translate(&e, &r, d, chip->quirks, chip->memoryMask)) {
+            e = before;
+            r = allocated;
+            break;
+        }
+        length++;
+        address = next;
+    }
+    if (end < address) {
+        end = address;
+    }
+    if (!closed) {
+        emitStorePC(&e, address);
+    }
+
+    if (length == 0) {
+        entry->hits = JIT_THRESHOLD + 1;
+        return;
+    }
+
+    protect(jit, 1);
+    emitter block = { jit->buffer + jit->used, 0 };
+    byte saved[16];
+    byte savedCount = savedRegisters(&r, saved);
+    for (byte i = 0; i < savedCount; i++) {
+        emitPush(&block, saved[i]);
+    }
+    emit(&block, 0x48);
+    emit(&block, 0x89);
+#ifdef _WIN32
+    emit(&block, 0xCB);                                       // mov rbx, rcx
+#else
+    emit(&block, 0xFB);                                       // mov rbx, rdi
+#endif
+    // Loaded once here and written back once on the way out; PC is assigned by every block before it
+    // returns, so it is only written back
+    for (byte x = 0; x < 0x10; x++) {
+        if (r.host[x] >= 0) {
+            emitRbxRex(&block, 0x8A, r.host[x], OFFSET_V(x));
+        }
+    }
+    if (r.usesI) {
+        emitRex(&block, 0, REG_I, 0);                          // movzx r15d, word [I]
+        emit(&block, 0x0F);
+        emitRbx(&block, 0xB7, REG_I, OFFSET_I);
+    }
+    memcpy(block.code + block.size, body, e.size);
+    block.size += e.size;
+    for (byte x = 0; x < 0x10; x++) {
+        if ((r.written >> x) & 1) {
+            emitRbxRex(&block, 0x88, r.host[x], OFFSET_V(x));
+        }
+    }
+    if (r.writesI) {
+        emit(&block, 0x66);
+        emitRbxRex(&block, 0x89, REG_I, OFFSET_I);
+    }
+    emit(&block, 0x66);
+    emitRbxRex(&block, 0x89, REG_PC, OFFSET_PC);
+    emit(&block, 0xB8);                                       // mov eax, length
+    emit32(&block, length);
+    for (byte i = savedCount; i > 0; i--) {
+        emitPop(&block, saved[i - 1]);
+    }
+    emit(&block, 0xC3);
+    protect(jit, 0);
+
+    entry->code = (jitCode)(jit->buffer + jit->used);
+    entry->end = end;
+    entry->length = length;
+    memset(jit->covered + start, 1, end - start);
+    jit->used += block.size;
+}
+
+chip8stop runJit(chip8* chip, int budget) {
+    if (chip->jit == NULL) {
+        chip->jit = jitCreate();
+        if (chip->jit == NULL) {
+            return runInterpreter(chip, budget);
+        }
+    }
+    jitState* jit = chip->jit;
+
+    int count = budget;
+    while (count > 0) {
+        chip->PC &= chip->memoryMask;
+        // XO-CHIP code above 4 KiB is never translated
+        jitEntry* entry = chip->PC < 0x1000 ? &jit->entries[chip->PC] : NULL;
+        if (entry && entry->code == NULL && entry->hits <= JIT_THRESHOLD && ++entry->hits == JIT_THRESHOLD) {
+            compile(jit, chip, chip->PC);
+        }
+        if (entry && entry->code && entry->length <= count) {
+            int retired = entry->code(chip);
+            count -= retired;
+            chip->instructions += retired;
+        } else {
+            count--;
+            chip8stop stop = runInterpreter(chip, 1);
+            if (stop != STOP_BUDGET) {
+                return stop;
+            }
+        }
+    }
+    return STOP_BUDGET;
+}
+
+void jitInvalidate(jitState* jit, word address) {
+    if (!jit->covered[address]) {
+        return;
+    }
+    jit->covered[address] = 0;
+    // A block closed by a skip also covers the word after it
+    int first = address - JIT_MAX_BLOCK * 2 - 2;
+    for (int start = first < 0 ? 0 : first; start <= address; start++) {
+        jitEntry* entry = &jit->entries[start];
+        if (entry->code && entry->end > address) {
+            entry->code = NULL;
+            entry->hits = 0;
+        }
+    }
+}
+
+void jitFlush(jitState* jit) {
+    memset(jit->entries, 0, sizeof(jit->entries));
+    memset(jit->covered, 0, sizeof(jit->covered));
+    jit->used = 0;
+}
+
+void jitDestroy(jitState* jit) {
+    if (jit == NULL) {
+        return;
+    }
+#ifdef _WIN32
+    VirtualFree(jit->buffer, 0, MEM_RELEASE);
+#else
+    munmap(jit->buffer, JIT_BUFFER_SIZE);
+#endif
+    free(jit);
+}
+
+#else
+
+// No code generator for this host: the JIT core is the interpreter
+chip8stop runJit(chip8* chip, int budget) {
+    return runInterpreter(chip, budget);
+}
+
+void jitInvalidate(jitState* jit, word address) {
+}
+
+void jitFlush(jitState* jit) {
+}
+
+void jitDestroy(jitState* jit) {
+}
+
+#endif
@@ -0,0 +1,27 @@
+#ifndef JIT_H
+#define JIT_H
+#include "chip8.h"
+
+// Native code for one translated block, returns the number of instructions it retired
+typedef int (*jitCode)(chip8* chip);
+
+typedef struct jitEntry {
+    jitCode code;
+    word end;
+    word hits;
+    byte length;
+} jitEntry;
+
+typedef struct jitState {
+    byte* buffer;
+    unsigned int used;
+    jitEntry entries[0x1000];
+    byte covered[0x1000];
+} jitState;
+
+chip8stop runJit(chip8* chip, int budget);
+void jitInvalidate(jitState* jit, word address);
+void jitFlush(jitState* jit);
+void jitDestroy(jitState* jit);
+
+#endif
@@ -1,71 +1,63 @@
 #include <stdio.h>
 #include <stdlib.h>
-#include <time.h>
+#include <string.h>
 #include <SDL2/SDL.h>
 #include "chip8.h"
 #include "config.h"
 #include "utils.h"
 #include "miniaudio.h"
+#include "trace.h"
+#include "pixels.h"
+#include "emulation.h"
+#include "sdlkeys.h"
+#ifdef CHIP8_AOT
+#include "aot.h"
 
-int CLOCKS_PER_FRAME = CLOCKS_PER_SEC / FRAMES_PER_SECOND;
+extern const aotProgram AOT_PROGRAM;
+#endif
 
-void set_pixel(SDL_Surface *surface, int x, int y, Uint32 pixel)
-{
-    Uint32 * const target_pixel = (Uint32 *) ((Uint8 *) surface->pixels
-                                               + y * surface->pitch
-                                               + x * surface->format->BytesPerPixel);
-    *target_pixel = pixel;
-}
-
-void setPixel(SDL_Window* window, int x, int y, int pixel) {
-
-    SDL_Surface* surface = SDL_GetWindowSurface(window);
-    for(int i = 0; i < SCREEN_COEFF; i++) {
-        for(int j = 0; j < SCREEN_COEFF; j++) {
-            set_pixel(surface, x * SCREEN_COEFF + j, y * SCREEN_COEFF + i, pixel);
-        }
-    }
-}
-
-void updateSurface(SDL_Surface* surface, chip8* chip) {
-    for(int i = 0; i < SCREEN_Y; i++) {
-        for(int j = 0; j < SCREEN_X; j++) {
-            if(chip->screen[i][j]) {
-                set_pixel(surface, j, i, 0xFFFFFFFF);
-            } else {
-                set_pixel(surface, j, i, 0x00000000);
-            }
-        }
-    }
-}
-
-int processSDLEvents(chip8* chip) {
+// Forwards key events to the emulation thread, stamped with when they happened; sets redraw when the
+// window needs presenting again. Tab runs at the turbo speed while held.
+int processSDLEvents(emulation* emu, byte* redraw, unsigned int speed, unsigned int turbo) {
+    // SDL stamps events in milliseconds since SDL_Init
+    long long ticksToMonotonic = monotonicNanoseconds() - SDL_GetTicks() * 1000000LL;
     SDL_Event windowEvent;
-    for(int i = 0; i < 0x10; i++) {
-        chip->keysNow[i] = 0;
-    }
     while (SDL_PollEvent(&windowEvent))
     {
         if (windowEvent.type == SDL_QUIT)
         {
             return EXIT_SUCCESS;
         }
-        if(windowEvent.type == SDL_KEYDOWN) {
-            byte key = keyToByte(SDL_GetKeyName(windowEvent.key.keysym.sym));
-            if(key < 0x10) {
-                chip->keys[key] = 0x1;
-            }
-        } else if(windowEvent.type == SDL_KEYUP) {
-            byte key = keyToByte(SDL_GetKeyName(windowEvent.key.keysym.sym));
+        if (windowEvent.type == SDL_WINDOWEVENT) {
+            // Exposed or resized: the last presented frame may be gone
+            *redraw = 1;
+        }
+        if ((windowEvent.type == SDL_KEYDOWN || windowEvent.type == SDL_KEYUP) && windowEvent.key.keysym.sym == SDLK_TAB) {
+            setEmulationSpeed(emu, windowEvent.type == SDL_KEYDOWN ? turbo : speed);
+            continue;
+        }
+        if((windowEvent.type == SDL_KEYDOWN || windowEvent.type == SDL_KEYUP) && !windowEvent.key.repeat) {
+            byte key = scancodeToKey(windowEvent.key.keysym.scancode);
             if(key < 0x10) {
-                chip->keysNow[key] = 0x1;
-                chip->keys[key] = 0x0;
+                inputEvent event = { key, windowEvent.type == SDL_KEYDOWN, ticksToMonotonic + windowEvent.key.timestamp * 1000000LL };
+                pushInput(&emu->input, event);
             }
         }
     }
     return EXIT_FAILURE;
 }
 
+// Comma-separated ARGB hex colours for pixel values 0 to 15; missing ones keep their default
+void parsePalette(const char* list, uint32_t* palette) {
+    char* end = (char*)list;
+    for (int i = 0; i < PALETTE_COLORS && *end; i++) {
+        palette[i] = (uint32_t)strtoul(end, &end, 16);
+        if (*end == ',') {
+            end++;
+        }
+    }
+}
+
 void data_callback(ma_device* pDevice, void* pOutput, const void* pInput, ma_uint32 frameCount)
 {
     if (((chip8*)pDevice->pUserData)->ST) { *(float*)pOutput = 0.5; }
@@ -75,10 +67,74 @@ void data_callback(ma_device* pDevice, void* pOutput, const void* pInput, ma_uin
 int main( int argc, char *argv[] )
 {
     const char* romPath = "./roms/5.ch8";
-    if(argc > 1) {
-        romPath = argv[1];
+    chip8core core = CORE_SWITCH;
+    byte quirks = DEFAULT_QUIRKS;
+    chip8timing timing = TIMING_INSTRUCTIONS;
+    byte extended = 0;
+    byte usePhosphor = 0;
+    byte reportJitter = 0;
+    byte vsync = 0;
+    unsigned long long ips = DEFAULT_IPS;
+    // Emulated frames per host frame, 0 for unlimited
+    unsigned int speed = 1;
+    unsigned int turbo = 0;
+    byte runAhead = 0;
+    const char* tracePath = NULL;
+    uint32_t palette[PALETTE_COLORS];
+    memcpy(palette, DEFAULT_PALETTE, sizeof(palette));
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--core") == 0 && i + 1 < argc) {
+            core = parseCore(argv[++i]);
+        } else if (strcmp(argv[i], "--quirks") == 0 && i + 1 < argc) {
+            extended = strcmp(argv[i + 1], "xochip") == 0;
+            quirks = parseQuirks(argv[++i]);
+        } else if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc) {
+            tracePath = argv[++i];
+        } else if (strcmp(argv[i], "--palette") == 0 && i + 1 < argc) {
+            parsePalette(argv[++i], palette);
+        } else if (strcmp(argv[i], "--timing") == 0 && i + 1 < argc) {
+            timing = parseTiming(argv[++i]);
+        } else if (strcmp(argv[i], "--ips") == 0 && i + 1 < argc) {
+            ips = strtoull(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--speed") == 0 && i + 1 < argc) {
+            speed = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--turbo") == 0 && i + 1 < argc) {
+            turbo = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--phosphor") == 0) {
+            usePhosphor = 1;
+        } else if (strcmp(argv[i], "--run-ahead") == 0 && i + 1 < argc) {
+            runAhead = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--vsync") == 0) {
+            vsync = 1;
+        } else if (strcmp(argv[i], "--jitter") == 0) {
+            reportJitter = 1;
+        } else {
+            romPath = argv[i];
+        }
     }
+#ifdef CHIP8_AOT
+    // The ROM is baked into the binary along with its recompiled blocks
+    (void)romPath;
+    chip8* chip = createChip();
+    writeROM(chip, AOT_PROGRAM.rom, AOT_PROGRAM.size);
+    setQuirks(chip, AOT_PROGRAM.quirks);
+    attachAot(chip, &AOT_PROGRAM);
+    setCore(chip, CORE_AOT);
+    (void)quirks;
+    (void)extended;
+    (void)core;
+#else
     chip8* chip = initChip(romPath);
+    if (extended) {
+        setExtendedMemory(chip, 1);
+    }
+    setQuirks(chip, quirks);
+    setCore(chip, core);
+#endif
+    setTiming(chip, timing);
+    if (tracePath && startTrace(chip, tracePath) != SUCCESS) {
+        printf("Cannot trace to %s\n", tracePath);
+    }
 
     ma_device_config config = ma_device_config_init(ma_device_type_playback);
     config.playback.format = ma_format_f32;
@@ -101,34 +157,98 @@ int main( int argc, char *argv[] )
         return 1;
     }
 
-    SDL_Renderer* renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_ACCELERATED);
+    SDL_Renderer* renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_ACCELERATED | (vsync ? SDL_RENDERER_PRESENTVSYNC : 0));
 
-    int lastClockTime = 0;
+    // Rows are converted straight into the locked texture, without an intermediate surface
+    SDL_Texture* screenTexture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STREAMING, HIRES_X, HIRES_Y);
+    SDL_Rect visible = {0, 0, SCREEN_X, SCREEN_Y};
+    unsigned int presentedSequence = 0;
+    const frame* shown = NULL;
+    static phosphor glow;
+    Uint32 glowTicks = SDL_GetTicks();
 
-    SDL_Surface* screenSurface = SDL_CreateRGBSurface(0, SCREEN_X, SCREEN_Y, 32, 0xFF000000, 0x00FF0000, 0x0000FF00, 0x000000FF);
-    SDL_Texture* screenTexture = SDL_CreateTextureFromSurface(renderer, screenSurface);
-    SDL_Rect textureRect = {0, 0, SCREEN_X, SCREEN_Y};
+    // Emulation runs on its own thread; this one only handles events and presents. With vsync it
+    // runs here instead, each frame covering the measured refresh period, since presenting blocks.
+    static emulation emu;
+    refreshTracker refresh;
+    if (vsync) {
+        SDL_DisplayMode mode;
+        int rate = SDL_GetCurrentDisplayMode(SDL_GetWindowDisplayIndex(window), &mode) == 0 && mode.refresh_rate > 0
+                   ? mode.refresh_rate : FRAMES_PER_SECOND;
+        initEmulation(&emu, chip, ips);
+        startRefresh(&refresh, 1000000000LL / rate);
+    } else if (startEmulation(&emu, chip, ips) != SUCCESS) {
+        return 1;
+    }
+    setEmulationSpeed(&emu, speed);
+    setRunAhead(&emu, runAhead);
 
     while (1) {
-        for (int i = 0; i < TICKS_PER_FRAME; i++) {
-            if(processSDLEvents(chip) == EXIT_SUCCESS) {
-                return EXIT_SUCCESS;
-            };
-            if(executeInstruction(chip) == ERROR) {
-                chip->PC -= 2;
-                printf("Address: %04X\nOpcode: %04X\n\n", chip->PC, readWord(chip));
+        byte redraw = 0;
+        if(processSDLEvents(&emu, &redraw, speed, turbo) == EXIT_SUCCESS) {
+            stopEmulation(&emu);
+            if (reportJitter && vsync) {
+                printf("display: %.3f Hz measured\n", 1e9 / refresh.period);
+            } else if (reportJitter) {
+                printJitter(&emu.pace, "emulation", stdout);
             }
-            while (clock() - lastClockTime < CLOCKS_PER_FRAME / TICKS_PER_FRAME) {}
-            lastClockTime = clock();
+            // Flushes the rest of the trace to disk
+            stopTrace(chip);
+            return EXIT_SUCCESS;
         }
-        updateSurface(screenSurface, chip);
-        SDL_UpdateTexture(screenTexture, &textureRect, screenSurface->pixels, screenSurface->pitch);
 
-        SDL_RenderClear(renderer);
-        SDL_RenderCopy(renderer, screenTexture, NULL, NULL);
-        SDL_RenderPresent(renderer);
+        if (vsync) {
+            stepEmulation(&emu, stepRefresh(&refresh));
+            redraw = 1;
+        }
 
-        updateTimers(chip);
+        // Nothing is uploaded while the screen stays the same
+        const frame* next = takeFrame(&emu.frames);
+        uint64_t rows = 0;
+        if (next) {
+            // After a skipped frame the texture may be behind on rows this one did not touch
+            rows = next->sequence == presentedSequence + 1 ? next->dirtyRows : ~(uint64_t)0 >> (64 - HIRES_Y);
+            presentedSequence = next->sequence;
+            shown = next;
+            visible.w = next->hires ? HIRES_X : SCREEN_X;
+            visible.h = next->hires ? HIRES_Y : SCREEN_Y;
+        }
+        if (usePhosphor && shown) {
+            // The glow keeps fading between published frames, at the emulated frame rate
+            int frames = (SDL_GetTicks() - glowTicks) * FRAMES_PER_SECOND / 1000;
+            glowTicks += frames * 1000 / FRAMES_PER_SECOND;
+            rows = stepPhosphor(&glow, &shown->screen, rows, frames);
+        }
+        if (rows) {
+            int first = 0;
+            while (!((rows >> first) & 1)) {
+                first++;
+            }
+            int last = HIRES_Y - 1;
+            while (!((rows >> last) & 1)) {
+                last--;
+            }
+            // Locked pixels start out undefined, so every row of the band is converted
+            SDL_Rect band = {0, first, HIRES_X, last - first + 1};
+            void* pixels;
+            int pitch;
+            if (SDL_LockTexture(screenTexture, &band, &pixels, &pitch) == 0) {
+                if (usePhosphor) {
+                    convertPhosphorRows(&glow, first, last, palette, pixels, pitch);
+                } else {
+                    convertRows(&shown->screen, first, last, palette, pixels, pitch);
+                }
+                SDL_UnlockTexture(screenTexture);
+            }
+            redraw = 1;
+        }
+        if (redraw) {
+            SDL_RenderClear(renderer);
+            SDL_RenderCopy(renderer, screenTexture, &visible, NULL);
+            SDL_RenderPresent(renderer);
+        } else {
+            SDL_Delay(1);
+        }
     }
     ma_device_uninit(&device);
 }
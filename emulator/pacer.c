@@ -0,0 +1,93 @@
+#include "pacer.h"
+
+#include <errno.h>
+#include <math.h>
+#include <time.h>
+
+#include "config.h"
+
+#if defined(__x86_64__) || defined(_M_X64)
+#include <immintrin.h>
+#define SPIN_HINT() _mm_pause()
+#else
+#define SPIN_HINT() ((void)0)
+#endif
+
+long long monotonicNanoseconds(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000000000LL + now.tv_nsec;
+}
+
+void startPacer(pacer* p, long long period) {
+    *p = (pacer){ 0 };
+    p->period = period;
+    p->deadline = monotonicNanoseconds();
+}
+
+// Returns at the next deadline, or at once if it has already passed
+void waitPacer(pacer* p) {
+    p->deadline += p->period;
+    long long now = monotonicNanoseconds();
+    if (now - p->deadline > 1000000000LL) {
+        // Fell far behind (suspended, debugger): restart the schedule instead of catching up
+        p->deadline = now;
+        p->restarts++;
+        return;
+    }
+    long long wake = p->deadline - PACER_SPIN_NS;
+    if (wake > now) {
+        struct timespec until = { wake / 1000000000LL, wake % 1000000000LL };
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &until, NULL) == EINTR) {
+        }
+    }
+    while ((now = monotonicNanoseconds()) < p->deadline) {
+        SPIN_HINT();
+    }
+
+    long long late = now - p->deadline;
+    p->waits++;
+    p->lateTotal += late;
+    p->lateMax = late > p->lateMax ? late : p->lateMax;
+    p->lateSquares += (double)late * late;
+}
+
+// Starts the schedule over from now, keeping the jitter seen so far, after a stretch run unpaced
+void resyncPacer(pacer* p) {
+    p->deadline = monotonicNanoseconds();
+}
+
+// period is the display's nominal refresh period, the first estimate
+void startRefresh(refreshTracker* r, long long period) {
+    r->period = period;
+    r->last = monotonicNanoseconds();
+    r->behind = 0;
+}
+
+// Call once per present; returns the emulated nanoseconds the next frame should run
+long long stepRefresh(refreshTracker* r) {
+    long long now = monotonicNanoseconds();
+    long long interval = now - r->last;
+    r->last = now;
+    if (interval > REFRESH_STALL_FRAMES * r->period) {
+        // Stalled (dragged, minimised, suspended): pick up from here instead of catching up
+        r->behind = 0;
+        return r->period;
+    }
+    r->period += (interval - r->period) / REFRESH_SMOOTHING;
+    r->behind += interval;
+    long long step = r->period + (r->behind - r->period) / REFRESH_SMOOTHING;
+    step = step > 0 ? step : 0;
+    r->behind -= step;
+    return step;
+}
+
+void printJitter(const pacer* p, const char* name, FILE* stream) {
+    if (p->waits == 0) {
+        return;
+    }
+    double mean = (double)p->lateTotal / p->waits;
+    double variance = p->lateSquares / p->waits - mean * mean;
+    fprintf(stream, "%s: %llu waits, late by %.1f us mean, %.1f us deviation, %.1f us max, %llu restarts\n",
+            name, p->waits, mean / 1000, sqrt(variance > 0 ? variance : 0) / 1000, p->lateMax / 1000.0, p->restarts);
+}
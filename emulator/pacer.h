@@ -0,0 +1,37 @@
+#ifndef PACER_H
+#define PACER_H
+#include <stdio.h>
+
+// Wakes a loop at a fixed period on the monotonic clock. Most of each wait is a clock_nanosleep;
+// only the last PACER_SPIN_NS are spun, which absorbs the sleep's wake-up latency without
+// keeping a core busy. How late each wake-up was is kept for a jitter report.
+typedef struct pacer {
+    long long period;
+    long long deadline;
+    unsigned long long waits;
+    // Wake-up lateness past the deadline, in nanoseconds
+    long long lateTotal;
+    long long lateMax;
+    double lateSquares;
+    // Times the schedule was restarted after falling more than a second behind
+    unsigned long long restarts;
+} pacer;
+
+// Measures the interval between presents that block on vsync and turns it into the emulated time
+// each frame should cover: the smoothed refresh period, corrected by a share of whatever emulated
+// time has drifted from the monotonic clock, so the rate holds on any refresh rate with no drift.
+typedef struct refreshTracker {
+    long long period;
+    long long last;
+    // Monotonic time passed minus emulated time handed out
+    long long behind;
+} refreshTracker;
+
+long long monotonicNanoseconds(void);
+void startPacer(pacer* p, long long period);
+void waitPacer(pacer* p);
+void resyncPacer(pacer* p);
+void startRefresh(refreshTracker* r, long long period);
+long long stepRefresh(refreshTracker* r);
+void printJitter(const pacer* p, const char* name, FILE* stream);
+#endif
@@ -0,0 +1,263 @@
+#include "pixels.h"
+
+#include <string.h>
+
+#include "config.h"
+
+#if defined(__x86_64__) || defined(_M_X64)
+#include <immintrin.h>
+#define PIXELS_SSE2
+#if defined(__GNUC__)
+#define PIXELS_AVX2
+#endif
+#endif
+
+typedef void (*rowConverter)(const chip8screen* screen, int y, const uint32_t* palette, uint32_t* out);
+
+#ifndef PIXELS_SSE2
+static void convertRowScalar(const chip8screen* screen, int y, const uint32_t* palette, uint32_t* out) {
+    for (int x = 0; x < HIRES_X; x++) {
+        out[x] = palette[screenPixel(screen, x, y) & (PALETTE_COLORS - 1)];
+    }
+}
+#endif
+
+#ifdef CHIP8_PACKED_SCREEN
+// Planes above the first with anything on row y; zero for every row a plain CHIP-8 program draws
+static inline byte extraPlanes(const chip8screen* screen, int y) {
+    byte planes = 0;
+    for (byte p = 1; p < SCREEN_PLANES; p++) {
+        planes |= ((*screen)[p][y] != 0) << p;
+    }
+    return planes;
+}
+#endif
+
+#ifdef PIXELS_SSE2
+// Pixel values 0 and 1 only: one compare selects between the first two colours
+static inline __m128i lookupTwoSSE2(__m128i values, const uint32_t* palette) {
+    __m128i on = _mm_cmpeq_epi32(values, _mm_set1_epi32(1));
+    __m128i background = _mm_set1_epi32(palette[0]);
+    __m128i difference = _mm_xor_si128(background, _mm_set1_epi32(palette[1]));
+    return _mm_xor_si128(background, _mm_and_si128(on, difference));
+}
+
+// Any pixel value: SSE2 has no variable shuffle, so the lanes go through the palette one at a time
+static inline __m128i lookupSSE2(__m128i values, const uint32_t* palette) {
+    uint32_t lanes[4];
+    _mm_storeu_si128((__m128i*)lanes, values);
+    return _mm_set_epi32(palette[lanes[3]], palette[lanes[2]], palette[lanes[1]], palette[lanes[0]]);
+}
+
+static inline __m128i lookupRowSSE2(__m128i values, const uint32_t* palette, byte twoColors) {
+    return twoColors ? lookupTwoSSE2(values, palette) : lookupSSE2(values, palette);
+}
+
+static void convertRowSSE2(const chip8screen* screen, int y, const uint32_t* palette, uint32_t* out) {
+#ifdef CHIP8_PACKED_SCREEN
+    // Four pixels per step: their bits are broadcast and isolated against one mask per lane, then
+    // merged across the planes in use
+    const __m128i bits = _mm_set_epi32(1, 2, 4, 8);
+    byte planes = extraPlanes(screen, y) | 1;
+    for (int x = 0; x < HIRES_X; x += 4) {
+        __m128i values = _mm_setzero_si128();
+        for (byte p = 0; p < SCREEN_PLANES; p++) {
+            if (planes & (1 << p)) {
+                __m128i nibble = _mm_set1_epi32((int)(((*screen)[p][y] >> (HIRES_X - 4 - x)) & 0xF));
+                __m128i set = _mm_cmpeq_epi32(_mm_and_si128(nibble, bits), bits);
+                values = _mm_or_si128(values, _mm_and_si128(set, _mm_set1_epi32(1 << p)));
+            }
+        }
+        _mm_storeu_si128((__m128i*)(out + x), lookupRowSSE2(values, palette, planes == 1));
+    }
+#else
+    // Sixteen pixel bytes per load, widened to four vectors of 32-bit values; a row using only
+    // values 0 and 1 takes the two colour path
+    const byte* row = (*screen)[y];
+    const __m128i zero = _mm_setzero_si128();
+    __m128i used = zero;
+    for (int x = 0; x < HIRES_X; x += 16) {
+        used = _mm_or_si128(used, _mm_loadu_si128((const __m128i*)(row + x)));
+    }
+    byte twoColors = !_mm_movemask_epi8(_mm_cmpgt_epi8(used, _mm_set1_epi8(1)));
+    for (int x = 0; x < HIRES_X; x += 16) {
+        __m128i bytes = _mm_loadu_si128((const __m128i*)(row + x));
+        __m128i low = _mm_unpacklo_epi8(bytes, zero);
+        __m128i high = _mm_unpackhi_epi8(bytes, zero);
+        _mm_storeu_si128((__m128i*)(out + x), lookupRowSSE2(_mm_unpacklo_epi16(low, zero), palette, twoColors));
+        _mm_storeu_si128((__m128i*)(out + x + 4), lookupRowSSE2(_mm_unpackhi_epi16(low, zero), palette, twoColors));
+        _mm_storeu_si128((__m128i*)(out + x + 8), lookupRowSSE2(_mm_unpacklo_epi16(high, zero), palette, twoColors));
+        _mm_storeu_si128((__m128i*)(out + x + 12), lookupRowSSE2(_mm_unpackhi_epi16(high, zero), palette, twoColors));
+    }
+#endif
+}
+#endif
+
+#ifdef PIXELS_AVX2
+// The palette halves are permuted by the low three bits and the fourth bit picks the half
+__attribute__((target("avx2")))
+static inline __m256i lookupAVX2(__m256i values, __m256i low, __m256i high) {
+    __m256i upper = _mm256_slli_epi32(values, 28);
+    return _mm256_castps_si256(_mm256_blendv_ps(_mm256_castsi256_ps(_mm256_permutevar8x32_epi32(low, values)),
+                                                _mm256_castsi256_ps(_mm256_permutevar8x32_epi32(high, values)),
+                                                _mm256_castsi256_ps(upper)));
+}
+
+__attribute__((target("avx2")))
+static void convertRowAVX2(const chip8screen* screen, int y, const uint32_t* palette, uint32_t* out) {
+    const __m256i low = _mm256_loadu_si256((const __m256i*)palette);
+    const __m256i high = _mm256_loadu_si256((const __m256i*)(palette + 8));
+#ifdef CHIP8_PACKED_SCREEN
+    const __m256i bits = _mm256_set_epi32(1, 2, 4, 8, 16, 32, 64, 128);
+    byte planes = extraPlanes(screen, y) | 1;
+    for (int x = 0; x < HIRES_X; x += 8) {
+        __m256i values = _mm256_setzero_si256();
+        for (byte p = 0; p < SCREEN_PLANES; p++) {
+            if (planes & (1 << p)) {
+                __m256i octet = _mm256_set1_epi32((int)(((*screen)[p][y] >> (HIRES_X - 8 - x)) & 0xFF));
+                __m256i set = _mm256_cmpeq_epi32(_mm256_and_si256(octet, bits), bits);
+                values = _mm256_or_si256(values, _mm256_and_si256(set, _mm256_set1_epi32(1 << p)));
+            }
+        }
+        _mm256_storeu_si256((__m256i*)(out + x), lookupAVX2(values, low, high));
+    }
+#else
+    const byte* row = (*screen)[y];
+    for (int x = 0; x < HIRES_X; x += 8) {
+        __m256i values = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)(row + x)));
+        _mm256_storeu_si256((__m256i*)(out + x), lookupAVX2(values, low, high));
+    }
+#endif
+}
+#endif
+
+static rowConverter selectConverter(void) {
+#ifdef PIXELS_AVX2
+    if (__builtin_cpu_supports("avx2")) {
+        return convertRowAVX2;
+    }
+#endif
+#ifdef PIXELS_SSE2
+    return convertRowSSE2;
+#else
+    return convertRowScalar;
+#endif
+}
+
+void convertRows(const chip8screen* screen, int first, int last, const uint32_t* palette, uint32_t* pixels, int pitch) {
+    static rowConverter convertRow = NULL;
+    if (convertRow == NULL) {
+        convertRow = selectConverter();
+    }
+    for (int y = first; y <= last; y++) {
+        convertRow(screen, y, palette, (uint32_t*)((byte*)pixels + (y - first) * pitch));
+    }
+}
+
+// Steps one row of the glow; returns whether a pixel on it is still fading
+#ifdef PIXELS_SSE2
+static byte stepRow(byte* intensity, byte* value, const byte* pixels, byte decay) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i full = _mm_set1_epi8((char)0xFF);
+    const __m128i step = _mm_set1_epi8((char)decay);
+    __m128i fading = zero;
+    for (int x = 0; x < HIRES_X; x += 16) {
+        __m128i current = _mm_loadu_si128((const __m128i*)(pixels + x));
+        __m128i off = _mm_cmpeq_epi8(current, zero);
+        __m128i level = _mm_or_si128(_mm_subs_epu8(_mm_loadu_si128((const __m128i*)(intensity + x)), step), _mm_andnot_si128(off, full));
+        __m128i lit = _mm_or_si128(_mm_and_si128(off, _mm_loadu_si128((const __m128i*)(value + x))), current);
+        fading = _mm_or_si128(fading, _mm_and_si128(off, level));
+        _mm_storeu_si128((__m128i*)(intensity + x), level);
+        _mm_storeu_si128((__m128i*)(value + x), lit);
+    }
+    return _mm_movemask_epi8(_mm_cmpeq_epi8(fading, zero)) != 0xFFFF;
+}
+#else
+static byte stepRow(byte* intensity, byte* value, const byte* pixels, byte decay) {
+    byte fading = 0;
+    for (int x = 0; x < HIRES_X; x++) {
+        if (pixels[x]) {
+            intensity[x] = 0xFF;
+            value[x] = pixels[x];
+        } else {
+            intensity[x] = intensity[x] > decay ? intensity[x] - decay : 0;
+            fading |= intensity[x];
+        }
+    }
+    return fading != 0;
+}
+#endif
+
+// Only dirty rows and rows still fading are touched, so a still screen costs nothing
+uint64_t stepPhosphor(phosphor* glow, const chip8screen* screen, uint64_t dirtyRows, int frames) {
+    uint64_t rows = dirtyRows | (frames ? glow->fadingRows : 0);
+    byte decay = frames * PHOSPHOR_DECAY > 0xFF ? 0xFF : frames * PHOSPHOR_DECAY;
+    for (int y = 0; y < HIRES_Y; y++) {
+        if (!((rows >> y) & 1)) {
+            continue;
+        }
+#ifdef CHIP8_PACKED_SCREEN
+        byte pixels[HIRES_X];
+        for (int x = 0; x < HIRES_X; x++) {
+            pixels[x] = screenPixel(screen, x, y);
+        }
+#else
+        const byte* pixels = (*screen)[y];
+#endif
+        uint64_t bit = (uint64_t)1 << y;
+        if (stepRow(glow->intensity[y], glow->value[y], pixels, decay)) {
+            glow->fadingRows |= bit;
+        } else {
+            glow->fadingRows &= ~bit;
+        }
+    }
+    return rows;
+}
+
+#ifdef PIXELS_SSE2
+// Two pixels of 16-bit channels: (colour * weight + background * (256 - weight)) >> 8
+static inline __m128i blendSSE2(__m128i colors, __m128i background, __m128i weights) {
+    const __m128i zero = _mm_setzero_si128();
+    __m128i inverse = _mm_sub_epi16(_mm_set1_epi16(0x100), weights);
+    __m128i sum = _mm_add_epi16(_mm_mullo_epi16(colors, weights), _mm_mullo_epi16(_mm_unpacklo_epi8(background, zero), inverse));
+    return _mm_srli_epi16(sum, 8);
+}
+
+static void convertPhosphorRow(const phosphor* glow, int y, const uint32_t* palette, uint32_t* out) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i background = _mm_set1_epi32(palette[0]);
+    for (int x = 0; x < HIRES_X; x += 4) {
+        uint32_t values;
+        uint32_t levels;
+        memcpy(&values, &glow->value[y][x], sizeof(values));
+        memcpy(&levels, &glow->intensity[y][x], sizeof(levels));
+        __m128i colors = lookupSSE2(_mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(values), zero), zero), palette);
+        // Intensity 0..255 as weight 0..256, repeated over the four channels of its pixel
+        __m128i level = _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(levels), zero), zero);
+        level = _mm_add_epi32(level, _mm_srli_epi32(level, 7));
+        level = _mm_or_si128(level, _mm_slli_epi32(level, 16));
+        __m128i low = blendSSE2(_mm_unpacklo_epi8(colors, zero), background, _mm_shuffle_epi32(level, _MM_SHUFFLE(1, 1, 0, 0)));
+        __m128i high = blendSSE2(_mm_unpackhi_epi8(colors, zero), background, _mm_shuffle_epi32(level, _MM_SHUFFLE(3, 3, 2, 2)));
+        _mm_storeu_si128((__m128i*)(out + x), _mm_packus_epi16(low, high));
+    }
+}
+#else
+static void convertPhosphorRow(const phosphor* glow, int y, const uint32_t* palette, uint32_t* out) {
+    for (int x = 0; x < HIRES_X; x++) {
+        uint32_t color = palette[glow->value[y][x] & (PALETTE_COLORS - 1)];
+        uint32_t weight = glow->intensity[y][x] + (glow->intensity[y][x] >> 7);
+        uint32_t blended = 0;
+        for (int shift = 0; shift < 32; shift += 8) {
+            uint32_t channel = ((color >> shift & 0xFF) * weight + (palette[0] >> shift & 0xFF) * (0x100 - weight)) >> 8;
+            blended |= channel << shift;
+        }
+        out[x] = blended;
+    }
+}
+#endif
+
+void convertPhosphorRows(const phosphor* glow, int first, int last, const uint32_t* palette, uint32_t* pixels, int pitch) {
+    for (int y = first; y <= last; y++) {
+        convertPhosphorRow(glow, y, palette, (uint32_t*)((byte*)pixels + (y - first) * pitch));
+    }
+}
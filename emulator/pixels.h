@@ -0,0 +1,34 @@
+#ifndef PIXELS_H
+#define PIXELS_H
+#include <stdint.h>
+
+#include "chip8.h"
+
+// ARGB colour per pixel value; values above 1 come from the extra XO-CHIP planes
+#define PALETTE_COLORS 16
+
+static const uint32_t DEFAULT_PALETTE[PALETTE_COLORS] = {
+    0xFF000000, 0xFFFFFFFF, 0xFFAAAAAA, 0xFF555555, 0xFFFF0000, 0xFF00FF00, 0xFF0000FF, 0xFFFFFF00,
+    0xFF880000, 0xFF008800, 0xFF000088, 0xFF888800, 0xFFFF00FF, 0xFF00FFFF, 0xFF880088, 0xFF008888,
+};
+
+// Converts screen rows first..last to ARGB, writing row first at pixels; pitch is in bytes
+void convertRows(const chip8screen* screen, int first, int last, const uint32_t* palette, uint32_t* pixels, int pitch);
+
+// Persistence buffer that lets pixels fade out instead of vanishing, hiding the flicker of sprites
+// erased and redrawn through XOR
+typedef struct phosphor {
+    // 255 while the pixel is on, then down by PHOSPHOR_DECAY every frame
+    byte intensity[HIRES_Y][HIRES_X];
+    // Value of the pixel when it was last on, the colour it fades from
+    byte value[HIRES_Y][HIRES_X];
+    // Rows with a pixel still fading
+    uint64_t fadingRows;
+} phosphor;
+
+// Advances the glow by frames and takes in the dirty rows of screen; returns the rows that changed
+uint64_t stepPhosphor(phosphor* glow, const chip8screen* screen, uint64_t dirtyRows, int frames);
+// Like convertRows, blending each pixel's colour into palette[0] by its intensity
+void convertPhosphorRows(const phosphor* glow, int first, int last, const uint32_t* palette, uint32_t* pixels, int pitch);
+
+#endif
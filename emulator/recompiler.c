@@ -0,0 +1,246 @@
+// Static recompiler: turns the code reachable from 0x200 in a ROM into one C function per basic
+// block, built on the same opcode handlers as the interpreter. The output defines AOT_PROGRAM and
+// is linked into the frontend with CHIP8_AOT defined.
+//
+// usage: recompiler <rom.ch8> <output.c> [quirks]
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "chip8.h"
+#include "chip8ops.h"
+#include "config.h"
+
+static const char* const HANDLER_NAMES[OP_COUNT] = {
+#define HANDLER_NAME(name) [OP_##name] = "op" #name,
+#define QUIRK_HANDLER_NAME(name) [OP_##name] = "CORE_FN(op" #name ")",
+    OPCODE_HANDLERS(HANDLER_NAME)
+    QUIRK_HANDLERS(QUIRK_HANDLER_NAME)
+#undef QUIRK_HANDLER_NAME
+#undef HANDLER_NAME
+};
+
+typedef enum blockRole {
+    ROLE_BODY,
+    ROLE_FINAL,
+    ROLE_INTERPRETED
+} blockRole;
+
+// Control flow, anything touching the screen and memory stores end a block, as does F000 nnnn since it
+// moves PC past its address word; Fx0A and unknown opcodes stay interpreted
+static blockRole roleOf(byte op) {
+    switch (op) {
+        case OP_JP:
+        case OP_CALL:
+        case OP_RET:
+        case OP_JP_V0:
+        case OP_SE_BYTE:
+        case OP_SNE_BYTE:
+        case OP_SE_REG:
+        case OP_SNE_REG:
+        case OP_SKP:
+        case OP_SKNP:
+        case OP_CLS:
+        case OP_DRW:
+        case OP_LD_B:
+        case OP_LD_MEM_VX:
+        case OP_SCD:
+        case OP_SCR:
+        case OP_SCL:
+        case OP_EXIT:
+        case OP_LOW:
+        case OP_HIGH:
+        case OP_SCU:
+        case OP_SAVE_RANGE:
+        case OP_LD_I_LONG:
+            return ROLE_FINAL;
+        case OP_LD_VX_K:
+        case OP_UNKNOWN:
+            return ROLE_INTERPRETED;
+        default:
+            return ROLE_BODY;
+    }
+}
+
+typedef struct recompiler {
+    chip8* chip;
+    word romEnd;
+    FILE* out;
+    byte queued[0x1000];
+    word worklist[0x1000];
+    int pending;
+    byte lengths[0x1000];
+    word ends[0x1000];
+} recompiler;
+
+static void enqueue(recompiler* r, word address) {
+    address &= 0x0FFF;
+    if (address < 0x200 || address + 1 >= r->romEnd || r->queued[address]) {
+        return;
+    }
+    r->queued[address] = 1;
+    r->worklist[r->pending++] = address;
+}
+
+static void emitCall(recompiler* r, const decoded* d) {
+    fprintf(r->out, "%s(chip, &(const decoded){ .x = 0x%X, .y = 0x%X, .n = 0x%X, .nn = 0x%02X, .nnn = 0x%03X })",
+            HANDLER_NAMES[d->op], d->x, d->y, d->n, d->nn, d->nnn);
+}
+
+// Length of the instruction at address, so a skip lands past all of an F000 nnnn
+static word instructionLength(recompiler* r, word address) {
+    return readMemory(r->chip, address) == 0xF0 && readMemory(r->chip, address + 1) == 0x00 ? 4 : 2;
+}
+
+static void emitSuccessors(recompiler* r, const decoded* d, word next) {
+    switch (d->op) {
+        case OP_JP:
+            enqueue(r, d->nnn);
+            break;
+        case OP_CALL:
+            enqueue(r, d->nnn);
+            enqueue(r, next);
+            break;
+        case OP_RET:
+        case OP_JP_V0:
+            break;
+        case OP_SE_BYTE:
+        case OP_SNE_BYTE:
+        case OP_SE_REG:
+        case OP_SNE_REG:
+        case OP_SKP:
+        case OP_SKNP:
+            enqueue(r, next);
+            enqueue(r, next + instructionLength(r, next));
+            break;
+        case OP_LD_I_LONG:
+            enqueue(r, next + 2);
+            break;
+        default:
+            enqueue(r, next);
+    }
+}
+
+static void compileBlock(recompiler* r, word start) {
+    decoded d;
+    word address = start;
+    byte length = 0;
+
+    decodeInstruction(r->chip, address, &d);
+    if (roleOf(d.op) == ROLE_INTERPRETED) {
+        enqueue(r, address + 2);
+        return;
+    }
+
+    fprintf(r->out, "static chip8stop block_%03X(chip8* chip) {\n", start);
+    while (1) {
+        decodeInstruction(r->chip, address, &d);
+        word next = address + 2;
+        blockRole role = roleOf(d.op);
+        if (role == ROLE_INTERPRETED || length == AOT_MAX_BLOCK || next > r->romEnd) {
+            fprintf(r->out, "    chip->PC = 0x%03X;\n    return STOP_NONE;\n", address);
+            enqueue(r, address);
+            break;
+        }
+        length++;
+        if (role == ROLE_FINAL) {
+            fprintf(r->out, "    chip->PC = 0x%03X;\n    return ", next);
+            emitCall(r, &d);
+            fprintf(r->out, ";\n");
+            emitSuccessors(r, &d, next);
+            address = d.op == OP_LD_I_LONG ? next + 2 : next;
+            break;
+        }
+        fprintf(r->out, "    ");
+        emitCall(r, &d);
+        fprintf(r->out, ";\n");
+        address = next;
+    }
+    fprintf(r->out, "}\n\n");
+    r->lengths[start] = length;
+    r->ends[start] = address;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 3) {
+        fprintf(stderr, "usage: %s <rom.ch8> <output.c> [quirks]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    byte quirks = DEFAULT_QUIRKS;
+    if (argc > 3) {
+        char* end;
+        long value = strtol(argv[3], &end, 16);
+        if (*argv[3] == '\0' || *end != '\0' || value < 0 || value >= QUIRK_PROFILES) {
+            fprintf(stderr, "usage: %s <rom.ch8> <output.c> [quirks]\nquirks must be a hex value below %X\n", argv[0], QUIRK_PROFILES);
+            return EXIT_FAILURE;
+        }
+        quirks = (byte)value;
+    }
+
+    // Up to the end of the XO-CHIP address space; blocks are only compiled below 0x1000
+    static byte rom[0xFE00];
+    FILE* file = fopen(argv[1], "rb");
+    if (file == NULL) {
+        fprintf(stderr, "cannot open %s\n", argv[1]);
+        return EXIT_FAILURE;
+    }
+    int size = fread(rom, 1, sizeof(rom), file);
+    fclose(file);
+    if (size <= 0) {
+        fprintf(stderr, "%s is empty\n", argv[1]);
+        return EXIT_FAILURE;
+    }
+
+    static recompiler r;
+    r.chip = createChip();
+    writeROM(r.chip, rom, size);
+    // The last word before the wrap to 0x000 is left to the interpreter
+    r.romEnd = 0x200 + size < 0x0FFE ? 0x200 + size : 0x0FFE;
+    r.out = fopen(argv[2], "w");
+    if (r.out == NULL) {
+        fprintf(stderr, "cannot write %s\n", argv[2]);
+        return EXIT_FAILURE;
+    }
+
+    fprintf(r.out, "// Generated by recompiler from %s, do not edit\n", argv[1]);
+    fprintf(r.out, "#include \"aot.h\"\n#include \"chip8ops.h\"\n\n");
+    fprintf(r.out, "#define CORE_QUIRKS %d\n#define CORE_HANDLERS_ONLY\n#include \"chip8core.inc\"\n\n", quirks);
+    fprintf(r.out, "#define CORE_QUIRKS %d\n\n", quirks);
+
+    fprintf(r.out, "static const byte ROM[%d] = {", size);
+    for (int i = 0; i < size; i++) {
+        fprintf(r.out, "%s0x%02X,", i % 16 ? " " : "\n    ", rom[i]);
+    }
+    fprintf(r.out, "\n};\n\n");
+
+    enqueue(&r, 0x200);
+    while (r.pending > 0) {
+        compileBlock(&r, r.worklist[--r.pending]);
+    }
+
+    fprintf(r.out, "const aotProgram AOT_PROGRAM = {\n");
+    fprintf(r.out, "    .rom = ROM,\n    .size = sizeof(ROM),\n    .quirks = %d,\n", quirks);
+    fprintf(r.out, "    .blocks = {\n");
+    for (int address = 0; address < 0x1000; address++) {
+        if (r.lengths[address]) {
+            fprintf(r.out, "        [0x%03X] = block_%03X,\n", address, address);
+        }
+    }
+    fprintf(r.out, "    },\n    .lengths = {\n");
+    for (int address = 0; address < 0x1000; address++) {
+        if (r.lengths[address]) {
+            fprintf(r.out, "        [0x%03X] = %d,\n", address, r.lengths[address]);
+        }
+    }
+    fprintf(r.out, "    },\n    .ends = {\n");
+    for (int address = 0; address < 0x1000; address++) {
+        if (r.lengths[address]) {
+            fprintf(r.out, "        [0x%03X] = 0x%03X,\n", address, r.ends[address]);
+        }
+    }
+    fprintf(r.out, "    },\n};\n");
+
+    fclose(r.out);
+    destroyChip(r.chip);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,87 @@
+// Check: a ROM drawing random digits at random places runs the same with run-ahead as without it, on
+// every interpreter core. The real machine must end each frame in the same state, and the screen
+// published with run-ahead must be the one the plain run reaches that many frames later.
+//
+// usage: runahead [frames]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "chip8.h"
+#include "emulation.h"
+
+static const byte RANDOM_DIGITS[] = {
+    0xC0, 0x3F, // V0 = random & 0x3F
+    0xC1, 0x1F, // V1 = random & 0x1F
+    0xC2, 0x0F, // V2 = random & 0x0F
+    0xF2, 0x29, // I = digit V2
+    0xD0, 0x15, // draw it at V0, V1
+    0x12, 0x00  // again
+};
+
+static const byte RUN_AHEAD = 2;
+
+static emulation plain;
+static emulation ahead;
+// A plain run started RUN_AHEAD frames early, showing what run-ahead should publish
+static emulation future;
+
+static int sameMachine(const chip8* a, const chip8* b) {
+    return memcmp(a->screen, b->screen, sizeof(a->screen)) == 0 && memcmp(a->V, b->V, sizeof(a->V)) == 0 &&
+           a->I == b->I && a->PC == b->PC && a->DT == b->DT && a->rng == b->rng &&
+           a->instructions == b->instructions;
+}
+
+static chip8* startRun(emulation* emu, chip8core core) {
+    chip8* chip = createChip();
+    writeROM(chip, RANDOM_DIGITS, sizeof(RANDOM_DIGITS));
+    setCore(chip, core);
+    initEmulation(emu, chip, 2000);
+    return chip;
+}
+
+// Returns the first frame where the runs disagree, or -1
+static int compareRuns(chip8core core, int frames) {
+    long long period = 1000000000LL / FRAMES_PER_SECOND;
+    chip8* a = startRun(&plain, core);
+    chip8* b = startRun(&ahead, core);
+    chip8* c = startRun(&future, core);
+    setRunAhead(&ahead, RUN_AHEAD);
+    for (byte f = 0; f < RUN_AHEAD; f++) {
+        stepEmulation(&future, period);
+    }
+
+    static chip8screen shown;
+    int mismatch = -1;
+    for (int f = 0; f < frames && mismatch < 0; f++) {
+        stepEmulation(&plain, period);
+        stepEmulation(&ahead, period);
+        stepEmulation(&future, period);
+        const frame* published = takeFrame(&ahead.frames);
+        if (published) {
+            memcpy(shown, published->screen, sizeof(shown));
+        }
+        if (!sameMachine(a, b) || memcmp(shown, c->screen, sizeof(shown)) != 0) {
+            mismatch = f;
+        }
+    }
+    destroyChip(a);
+    destroyChip(b);
+    destroyChip(c);
+    return mismatch;
+}
+
+int main(int argc, char* argv[]) {
+    int frames = argc > 1 ? atoi(argv[1]) : 120;
+    int failed = 0;
+    for (chip8core core = CORE_SWITCH; core < CORE_AOT; core++) {
+        int mismatch = compareRuns(core, frames);
+        printf("core %d: %s", core, mismatch < 0 ? "identical\n" : "diverged at frame ");
+        if (mismatch >= 0) {
+            printf("%d\n", mismatch);
+            failed = 1;
+        }
+    }
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
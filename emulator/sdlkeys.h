@@ -0,0 +1,20 @@
+#ifndef SDLKEYS_H
+#define SDLKEYS_H
+#include <SDL2/SDL.h>
+
+#include "definitions.h"
+
+// CHIP-8 key plus one for each scancode, 0 for none: the digit keys and A to F, by position, so the
+// lookup needs no key name and works the same on every layout
+static const byte SCANCODE_KEYPAD[SDL_NUM_SCANCODES] = {
+    [SDL_SCANCODE_0] = 0x1, [SDL_SCANCODE_1] = 0x2, [SDL_SCANCODE_2] = 0x3, [SDL_SCANCODE_3] = 0x4,
+    [SDL_SCANCODE_4] = 0x5, [SDL_SCANCODE_5] = 0x6, [SDL_SCANCODE_6] = 0x7, [SDL_SCANCODE_7] = 0x8,
+    [SDL_SCANCODE_8] = 0x9, [SDL_SCANCODE_9] = 0xA, [SDL_SCANCODE_A] = 0xB, [SDL_SCANCODE_B] = 0xC,
+    [SDL_SCANCODE_C] = 0xD, [SDL_SCANCODE_D] = 0xE, [SDL_SCANCODE_E] = 0xF, [SDL_SCANCODE_F] = 0x10,
+};
+
+// The CHIP-8 key for a scancode, 0x10 for none
+static inline byte scancodeToKey(SDL_Scancode scancode) {
+    return (unsigned int)scancode < SDL_NUM_SCANCODES && SCANCODE_KEYPAD[scancode] ? SCANCODE_KEYPAD[scancode] - 1 : 0x10;
+}
+#endif
@@ -0,0 +1,308 @@
+// Headless frontend: runs a ROM on the emulation thread and draws it in the terminal, e.g. over SSH.
+// Half-block cells show two pixels each, braille cells eight; every frame only the cells that
+// changed are rewritten, each with a cursor move only when it does not follow the previous one.
+// Hex digit keys press CHIP-8 keys, Tab toggles the turbo speed, Ctrl-C quits.
+//
+// usage: term [--core name] [--quirks name] [--ips n] [--timing vip] [--speed n] [--turbo n] [--braille] [--jitter] <rom.ch8>
+
+#include <ctype.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include "chip8.h"
+#include "config.h"
+#include "emulation.h"
+#include "utils.h"
+
+#define CELL_ROWS (HIRES_Y / 2)
+#define CELL_COLUMNS HIRES_X
+
+// SGR foreground colour per pixel value; the background code is 10 higher
+static const byte TERM_COLORS[0x10] = { 39, 39, 37, 90, 31, 32, 34, 33, 91, 92, 94, 93, 35, 36, 95, 96 };
+
+// A cell as drawn: code point in the low 21 bits, then foreground and background pixel values
+typedef uint32_t cell;
+
+static inline cell makeCell(uint32_t glyph, byte foreground, byte background) {
+    return glyph | (uint32_t)foreground << 21 | (uint32_t)background << 25;
+}
+
+typedef struct terminal {
+    byte braille;
+    byte columns;
+    byte rows;
+    // Cells currently on the terminal, so unchanged ones are skipped
+    cell shown[CELL_ROWS][CELL_COLUMNS];
+    // Where the terminal cursor and colours are after the output so far, to leave out redundant codes
+    int cursorRow;
+    int cursorColumn;
+    byte foreground;
+    byte background;
+    char* out;
+    size_t length;
+    size_t capacity;
+} terminal;
+
+static volatile sig_atomic_t quit = 0;
+
+static void onSignal(int signal) {
+    quit = 1;
+}
+
+static void append(terminal* term, const char* text, size_t length) {
+    if (term->length + length > term->capacity) {
+        term->capacity = (term->length + length) * 2;
+        term->out = realloc(term->out, term->capacity);
+    }
+    memcpy(term->out + term->length, text, length);
+    term->length += length;
+}
+
+static void appendFormat(terminal* term, const char* format, int a, int b) {
+    char text[32];
+    int length = snprintf(text, sizeof(text), format, a, b);
+    append(term, text, length);
+}
+
+static void appendGlyph(terminal* term, uint32_t glyph) {
+    char text[3];
+    if (glyph < 0x80) {
+        text[0] = glyph;
+        append(term, text, 1);
+        return;
+    }
+    // Every glyph used here is below 0x10000: three bytes of UTF-8
+    text[0] = 0xE0 | glyph >> 12;
+    text[1] = 0x80 | ((glyph >> 6) & 0x3F);
+    text[2] = 0x80 | (glyph & 0x3F);
+    append(term, text, 3);
+}
+
+// Upper half block with the top pixel in the foreground and the bottom one in the background
+static cell halfBlockCell(byte top, byte bottom) {
+    if (top == bottom) {
+        return top ? makeCell(0x2588, top, 0) : makeCell(' ', 0, 0);
+    }
+    if (!top) {
+        return makeCell(0x2584, bottom, 0);
+    }
+    return makeCell(0x2580, top, bottom);
+}
+
+// Braille dot bits for the 2x4 pixels of a cell, by row then column
+static const byte BRAILLE_DOTS[4][2] = { { 0x01, 0x08 }, { 0x02, 0x10 }, { 0x04, 0x20 }, { 0x40, 0x80 } };
+
+// A braille cell has one colour, taken from the highest pixel value in it
+static cell brailleCell(const chip8screen* screen, int column, int row) {
+    byte dots = 0;
+    byte color = 0;
+    for (int y = 0; y < 4; y++) {
+        for (int x = 0; x < 2; x++) {
+            byte value = screenPixel(screen, column * 2 + x, row * 4 + y);
+            if (value) {
+                dots |= BRAILLE_DOTS[y][x];
+                color = value > color ? value : color;
+            }
+        }
+    }
+    return dots ? makeCell(0x2800 + dots, color, 0) : makeCell(' ', 0, 0);
+}
+
+static void drawCell(terminal* term, int row, int column, cell c) {
+    if (row != term->cursorRow || column != term->cursorColumn) {
+        appendFormat(term, "\x1b[%d;%dH", row + 1, column + 1);
+    }
+    byte foreground = (c >> 21) & 0xF;
+    byte background = (c >> 25) & 0xF;
+    if (foreground != term->foreground || background != term->background) {
+        appendFormat(term, "\x1b[%d;%dm", TERM_COLORS[foreground], (background ? TERM_COLORS[background] : 39) + 10);
+        term->foreground = foreground;
+        term->background = background;
+    }
+    appendGlyph(term, c & 0x1FFFFF);
+    term->cursorRow = row;
+    term->cursorColumn = column + 1;
+}
+
+// Rewrites the changed cells on the screen rows in dirtyRows
+static void drawFrame(terminal* term, const frame* f, uint64_t dirtyRows) {
+    byte pixelRows = term->braille ? 4 : 2;
+    for (int row = 0; row < term->rows; row++) {
+        uint64_t rowMask = (((uint64_t)1 << pixelRows) - 1) << (row * pixelRows);
+        if (!(dirtyRows & rowMask)) {
+            continue;
+        }
+        for (int column = 0; column < term->columns; column++) {
+            cell c = term->braille ? brailleCell(&f->screen, column, row)
+                                   : halfBlockCell(screenPixel(&f->screen, column, row * 2), screenPixel(&f->screen, column, row * 2 + 1));
+            if (c != term->shown[row][column]) {
+                term->shown[row][column] = c;
+                drawCell(term, row, column, c);
+            }
+        }
+    }
+}
+
+// Starts over on an empty terminal sized for the current resolution
+static void resetTerminal(terminal* term, byte hires) {
+    byte width = hires ? HIRES_X : SCREEN_X;
+    byte height = hires ? HIRES_Y : SCREEN_Y;
+    term->columns = term->braille ? width / 2 : width;
+    term->rows = term->braille ? height / 4 : height / 2;
+    for (int row = 0; row < CELL_ROWS; row++) {
+        for (int column = 0; column < CELL_COLUMNS; column++) {
+            term->shown[row][column] = makeCell(' ', 0, 0);
+        }
+    }
+    append(term, "\x1b[0m\x1b[2J\x1b[H", 11);
+    term->cursorRow = 0;
+    term->cursorColumn = 0;
+    term->foreground = 0;
+    term->background = 0;
+}
+
+// Terminals report key presses only, so each press is released TERM_KEY_FRAMES frames later and
+// Tab switches between speeds[0] and speeds[1] instead of being held
+static void readKeys(emulation* emu, int* releaseFrames, const unsigned int* speeds, byte* turbo) {
+    char input[64];
+    ssize_t count = read(STDIN_FILENO, input, sizeof(input));
+    long long now = monotonicNanoseconds();
+    for (ssize_t i = 0; i < count; i++) {
+        if (input[i] == '\t') {
+            *turbo = !*turbo;
+            setEmulationSpeed(emu, speeds[*turbo]);
+            continue;
+        }
+        char name[2] = { toupper((unsigned char)input[i]), 0 };
+        byte key = keyToByte(name);
+        if (key < 0x10) {
+            if (!releaseFrames[key]) {
+                inputEvent event = { key, 1, now };
+                pushInput(&emu->input, event);
+            }
+            releaseFrames[key] = TERM_KEY_FRAMES;
+        }
+    }
+    for (byte key = 0; key < 0x10; key++) {
+        if (releaseFrames[key] && --releaseFrames[key] == 0) {
+            inputEvent event = { key, 0, now };
+            pushInput(&emu->input, event);
+        }
+    }
+}
+
+int main(int argc, char* argv[]) {
+    const char* romPath = NULL;
+    chip8core core = CORE_SWITCH;
+    byte quirks = DEFAULT_QUIRKS;
+    chip8timing timing = TIMING_INSTRUCTIONS;
+    byte extended = 0;
+    byte reportJitter = 0;
+    unsigned long long ips = DEFAULT_IPS;
+    // Emulated frames per host frame, 0 for unlimited
+    unsigned int speeds[2] = { 1, 0 };
+    static terminal term;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--core") == 0 && i + 1 < argc) {
+            core = parseCore(argv[++i]);
+        } else if (strcmp(argv[i], "--quirks") == 0 && i + 1 < argc) {
+            extended = strcmp(argv[i + 1], "xochip") == 0;
+            quirks = parseQuirks(argv[++i]);
+        } else if (strcmp(argv[i], "--timing") == 0 && i + 1 < argc) {
+            timing = parseTiming(argv[++i]);
+        } else if (strcmp(argv[i], "--ips") == 0 && i + 1 < argc) {
+            ips = strtoull(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--speed") == 0 && i + 1 < argc) {
+            speeds[0] = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--turbo") == 0 && i + 1 < argc) {
+            speeds[1] = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--braille") == 0) {
+            term.braille = 1;
+        } else if (strcmp(argv[i], "--jitter") == 0) {
+            reportJitter = 1;
+        } else {
+            romPath = argv[i];
+        }
+    }
+    if (romPath == NULL) {
+        fprintf(stderr, "usage: %s [--core name] [--quirks name] [--ips n] [--timing vip] [--speed n] [--turbo n] [--braille] [--jitter] <rom.ch8>\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    chip8* chip = initChip(romPath);
+    if (extended) {
+        setExtendedMemory(chip, 1);
+    }
+    setQuirks(chip, quirks);
+    setCore(chip, core);
+    setTiming(chip, timing);
+
+    // Raw, non-blocking input; output is left alone apart from hiding the cursor
+    struct termios saved;
+    byte interactive = tcgetattr(STDIN_FILENO, &saved) == 0;
+    if (interactive) {
+        struct termios raw = saved;
+        raw.c_lflag &= ~(ICANON | ECHO);
+        raw.c_cc[VMIN] = 0;
+        raw.c_cc[VTIME] = 0;
+        tcsetattr(STDIN_FILENO, TCSANOW, &raw);
+    }
+    signal(SIGINT, onSignal);
+    signal(SIGTERM, onSignal);
+    fputs("\x1b[?25l", stdout);
+
+    static emulation emu;
+    if (startEmulation(&emu, chip, ips) != SUCCESS) {
+        return EXIT_FAILURE;
+    }
+    setEmulationSpeed(&emu, speeds[0]);
+
+    pacer pace;
+    startPacer(&pace, 1000000000LL / FRAMES_PER_SECOND);
+    int releaseFrames[0x10] = { 0 };
+    byte turbo = 0;
+    unsigned int presentedSequence = 0;
+    byte hires = 0xFF;
+    while (!quit) {
+        if (interactive) {
+            readKeys(&emu, releaseFrames, speeds, &turbo);
+        }
+        const frame* next = takeFrame(&emu.frames);
+        if (next) {
+            uint64_t rows = next->dirtyRows;
+            if (next->hires != hires || next->sequence != presentedSequence + 1) {
+                // Resized, or a skipped frame may have changed rows this one did not touch
+                if (next->hires != hires) {
+                    hires = next->hires;
+                    resetTerminal(&term, hires);
+                }
+                rows = ~(uint64_t)0 >> (64 - HIRES_Y);
+            }
+            presentedSequence = next->sequence;
+            drawFrame(&term, next, rows);
+            if (term.length) {
+                fwrite(term.out, 1, term.length, stdout);
+                fflush(stdout);
+                term.length = 0;
+            }
+        }
+        waitPacer(&pace);
+    }
+
+    stopEmulation(&emu);
+    destroyChip(chip);
+    fputs("\x1b[0m\x1b[?25h\n", stdout);
+    if (interactive) {
+        tcsetattr(STDIN_FILENO, TCSANOW, &saved);
+    }
+    if (reportJitter) {
+        printJitter(&emu.pace, "emulation", stdout);
+        printJitter(&pace, "terminal", stdout);
+    }
+    free(term.out);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,110 @@
+#include "trace.h"
+
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "config.h"
+#include "utils.h"
+
+// Writes whatever the emulating thread has published, then sleeps; exits once stopped and empty
+static void* drainTrace(void* argument) {
+    traceBuffer* trace = argument;
+    const struct timespec idle = { 0, 1000000 };
+    while (1) {
+        byte running = atomic_load_explicit(&trace->running, memory_order_acquire);
+        unsigned int tail = atomic_load_explicit(&trace->tail, memory_order_relaxed);
+        unsigned int head = atomic_load_explicit(&trace->head, memory_order_acquire);
+        if (head != tail) {
+            unsigned int start = tail & (trace->size - 1);
+            unsigned int length = head - tail;
+            if (length > trace->size - start) {
+                length = trace->size - start;
+            }
+            fwrite(trace->ring + start, 1, length, trace->file);
+            atomic_store_explicit(&trace->tail, tail + length, memory_order_release);
+        } else if (!running) {
+            break;
+        } else {
+            nanosleep(&idle, NULL);
+        }
+    }
+    return NULL;
+}
+
+chip8result startTrace(chip8* chip, const char* path) {
+    stopTrace(chip);
+    traceBuffer* trace = calloc(1, sizeof(traceBuffer));
+    if (trace == NULL) {
+        return ERROR;
+    }
+    trace->size = TRACE_BUFFER_BYTES;
+    trace->ring = malloc(trace->size);
+    trace->file = fopen(path, "wb");
+    if (trace->ring == NULL || trace->file == NULL) {
+        goto fail;
+    }
+    unsigned int magic = TRACE_MAGIC;
+    fwrite(&magic, sizeof(magic), 1, trace->file);
+    atomic_init(&trace->head, 0);
+    atomic_init(&trace->tail, 0);
+    atomic_init(&trace->running, 1);
+    if (pthread_create(&trace->drain, NULL, drainTrace, trace) != 0) {
+        goto fail;
+    }
+    chip->trace = trace;
+    return SUCCESS;
+
+fail:
+    if (trace->file) {
+        fclose(trace->file);
+    }
+    free(trace->ring);
+    free(trace);
+    return ERROR;
+}
+
+void stopTrace(chip8* chip) {
+    traceBuffer* trace = chip->trace;
+    if (trace == NULL) {
+        return;
+    }
+    chip->trace = NULL;
+    atomic_store_explicit(&trace->running, 0, memory_order_release);
+    pthread_join(trace->drain, NULL);
+    fclose(trace->file);
+    free(trace->ring);
+    free(trace);
+}
+
+// Records the instruction at PC before it runs; waits for the drain thread rather than drop records
+void traceInstruction(traceBuffer* trace, chip8* chip) {
+    byte record[sizeof(traceHeader) + 0x10];
+    traceHeader header = {
+        .pc = chip->PC & chip->memoryMask,
+        .instruction = parseWord(readMemory(chip, chip->PC), readMemory(chip, chip->PC + 1)),
+        .I = chip->I,
+        .changed = 0
+    };
+    unsigned int length = sizeof(traceHeader);
+    for (int i = 0; i < 0x10; i++) {
+        if (!trace->synced || chip->V[i] != trace->V[i]) {
+            header.changed |= 1 << i;
+            record[length++] = chip->V[i];
+            trace->V[i] = chip->V[i];
+        }
+    }
+    trace->synced = 1;
+    memcpy(record, &header, sizeof(header));
+
+    unsigned int head = atomic_load_explicit(&trace->head, memory_order_relaxed);
+    while (head - atomic_load_explicit(&trace->tail, memory_order_acquire) > trace->size - length) {
+        sched_yield();
+    }
+    for (unsigned int i = 0; i < length; i++) {
+        trace->ring[(head + i) & (trace->size - 1)] = record[i];
+    }
+    atomic_store_explicit(&trace->head, head + length, memory_order_release);
+}
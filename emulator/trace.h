@@ -0,0 +1,37 @@
+#ifndef TRACE_H
+#define TRACE_H
+#include <pthread.h>
+#include <stdio.h>
+
+#include "chip8.h"
+
+// "CH8T" at the start of every trace file
+#define TRACE_MAGIC 0x54384843u
+
+// One record per executed instruction, followed by one byte per bit set in changed: the new
+// values of those V registers since the previous record, lowest register first
+typedef struct traceHeader {
+    word pc;
+    word instruction;
+    word I;
+    word changed;
+} traceHeader;
+
+// Single producer (the emulating thread), single consumer (the drain thread) byte ring
+typedef struct traceBuffer {
+    FILE* file;
+    byte* ring;
+    unsigned int size;
+    _Atomic unsigned int head;
+    _Atomic unsigned int tail;
+    _Atomic byte running;
+    byte V[0x10];
+    byte synced;
+    pthread_t drain;
+} traceBuffer;
+
+chip8result startTrace(chip8* chip, const char* path);
+void stopTrace(chip8* chip);
+void traceInstruction(traceBuffer* trace, chip8* chip);
+
+#endif
@@ -0,0 +1,56 @@
+// Offline decoder for traces written by startTrace: prints every record in the text format the
+// LOGGING build printed while running. Traces are read on a machine with the recorder's byte order.
+//
+// usage: tracedump <trace.bin> [--index-register]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "trace.h"
+
+int main(int argc, char* argv[]) {
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s <trace.bin> [--index-register]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    byte showI = argc > 2 && strcmp(argv[2], "--index-register") == 0;
+
+    FILE* file = fopen(argv[1], "rb");
+    if (file == NULL) {
+        fprintf(stderr, "cannot open %s\n", argv[1]);
+        return EXIT_FAILURE;
+    }
+    unsigned int magic = 0;
+    if (fread(&magic, sizeof(magic), 1, file) != 1 || magic != TRACE_MAGIC) {
+        fprintf(stderr, "%s is not a trace\n", argv[1]);
+        fclose(file);
+        return EXIT_FAILURE;
+    }
+
+    byte V[0x10] = { 0 };
+    traceHeader header;
+    while (fread(&header, sizeof(header), 1, file) == 1) {
+        for (int i = 0; i < 0x10; i++) {
+            if ((header.changed >> i) & 1) {
+                int value = fgetc(file);
+                if (value == EOF) {
+                    fprintf(stderr, "truncated record at %03X\n", header.pc);
+                    fclose(file);
+                    return EXIT_FAILURE;
+                }
+                V[i] = value;
+            }
+        }
+        printf("Address: %03X\nInstruction: %04X\nRegisters: ", header.pc, header.instruction);
+        for(int i = 0; i < 0x10; i ++) {
+            printf("%02X ", V[i]);
+        }
+        if (showI) {
+            printf("\nI: %03X", header.I);
+        }
+        printf("\n\n\n");
+    }
+    fclose(file);
+    return EXIT_SUCCESS;
+}
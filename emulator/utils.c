@@ -1,6 +1,6 @@
 #include "utils.h"
 
-#include <SDL2/SDL_events.h>
+#include <string.h>
 
 word parseWord(byte byte1, byte byte2) {
     return (byte1 << 8) | byte2;
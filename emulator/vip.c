@@ -0,0 +1,115 @@
+#include "vip.h"
+
+// Machine cycles the VIP interpreter takes per instruction, fetch and decode included. 8xyn is slow
+// because the interpreter assembles and runs a small 1802 routine for it. The ones the VIP does not
+// have cost as much as a fetch.
+static const byte VIP_CYCLES[OP_COUNT] = {
+    [OP_SYS] = 10,
+    [OP_CLS] = 24,
+    [OP_RET] = 23,
+    [OP_JP] = 23,
+    [OP_CALL] = 23,
+    [OP_SE_BYTE] = 12,
+    [OP_SNE_BYTE] = 12,
+    [OP_SE_REG] = 16,
+    [OP_LD_BYTE] = 6,
+    [OP_ADD_BYTE] = 10,
+    [OP_LD_REG] = 44,
+    [OP_OR] = 44,
+    [OP_AND] = 44,
+    [OP_XOR] = 44,
+    [OP_ADD_REG] = 46,
+    [OP_SUB] = 48,
+    [OP_SHR] = 44,
+    [OP_SUBN] = 48,
+    [OP_SHL] = 44,
+    [OP_SNE_REG] = 16,
+    [OP_LD_I] = 12,
+    [OP_JP_V0] = 23,
+    [OP_RND] = 36,
+    [OP_SKP] = 16,
+    [OP_SKNP] = 16,
+    [OP_LD_VX_DT] = 10,
+    [OP_LD_VX_K] = 10,
+    [OP_LD_DT_VX] = 10,
+    [OP_LD_ST_VX] = 10,
+    [OP_ADD_I] = 19,
+    [OP_LD_F] = 20,
+};
+
+static const byte VIP_FETCH_CYCLES = 10;
+
+// The display DMA steals 8 machine cycles per scan line for 128 lines, and the interrupt routine that
+// drives it and counts the timers down takes the rest
+static const unsigned int VIP_DISPLAY_CYCLES = 1024 + 46;
+
+// Where a DRW stands with the display wait: the VIP interpreter draws only right after the
+// display interrupt, so every DRW stalls until the next vertical blank
+enum {
+    DISPLAY_IDLE,
+    DISPLAY_WAITING,
+    DISPLAY_RELEASED
+};
+
+static long long instructionCycles(const chip8* chip, const decoded* d) {
+    switch (d->op) {
+        case OP_DRW: {
+            // Each sprite byte is shifted right one bit at a time by x & 7, and an unaligned row
+            // is XORed into two screen bytes instead of one
+            byte shift = chip->V[d->x] & 7;
+            return 26 + d->n * (18 + 4 * shift + (shift ? 6 : 0));
+        }
+        case OP_LD_B: {
+            // Each digit is found by repeated subtraction
+            byte value = chip->V[d->x];
+            return 46 + 16 * (value / 100 + value / 10 % 10 + value % 10);
+        }
+        case OP_LD_MEM_VX:
+        case OP_LD_VX_MEM:
+            return 18 + 14 * (d->x + 1);
+        default:
+            return VIP_CYCLES[d->op] ? VIP_CYCLES[d->op] : VIP_FETCH_CYCLES;
+    }
+}
+
+// Runs instructions one at a time until budget machine cycles are spent; the last one may run
+// past it. Returns STOP_BUDGET, or whatever stopped the core early, including STOP_WAITING for a
+// DRW stalled until the next vipVblank.
+chip8stop runVip(chip8* chip, long long budget, long long* spent) {
+    *spent = 0;
+    while (*spent < budget) {
+        word address = chip->PC & chip->memoryMask;
+        decoded* d = &chip->cache[address];
+        if (d->op == OP_UNDECODED) {
+            decodeInstruction(chip, address, d);
+        }
+        if (d->op == OP_DRW) {
+            if (chip->displayWait != DISPLAY_RELEASED) {
+                chip->displayWait = DISPLAY_WAITING;
+                return STOP_WAITING;
+            }
+            chip->displayWait = DISPLAY_IDLE;
+        }
+        long long cycles = instructionCycles(chip, d);
+        chip8stop stop = runCycles(chip, 1);
+        if (stop == STOP_BREAKPOINT) {
+            return stop;
+        }
+        *spent += cycles;
+        chip->cycles += cycles;
+        if (stop == STOP_WAITING || stop == STOP_EXIT || stop == STOP_UNKNOWN) {
+            return stop;
+        }
+    }
+    return STOP_BUDGET;
+}
+
+// The display interrupt at the start of each frame; returns the machine cycles it and the display
+// take from the frame
+long long vipVblank(chip8* chip) {
+    if (chip->displayWait == DISPLAY_WAITING) {
+        chip->displayWait = DISPLAY_RELEASED;
+    }
+    chip->cycles += VIP_DISPLAY_CYCLES;
+    return VIP_DISPLAY_CYCLES;
+}
@@ -0,0 +1,11 @@
+#ifndef VIP_H
+#define VIP_H
+#include "chip8.h"
+
+// COSMAC VIP: the 1802 runs at 1.76064 MHz with 8 clocks per machine cycle, 3668 machine cycles per
+// 60 Hz frame
+static const unsigned int VIP_CYCLES_PER_SECOND = 220080;
+
+chip8stop runVip(chip8* chip, long long budget, long long* spent);
+long long vipVblank(chip8* chip);
+#endif
@@ -0,0 +1,252 @@
+// Wall of emulators for watching batch runs: every ROM on the command line runs in its own chip8, all
+// on this thread, and their screens are composited into one atlas texture. Each frame only the dirty
+// rows of each tile are converted, copied into the texture under one SDL_LockTexture and drawn with one
+// SDL_RenderCopy, however many instances there are.
+// Keys go to every instance. Instance i seeds its Cxkk generator with the --seed base plus i, so copies
+// of one ROM play differently and the same command line replays the same wall.
+//
+// usage: wall [--core name] [--quirks name] [--ips n] [--timing vip] [--columns n] [--copies n] [--seed n] [--jitter] <rom.ch8>...
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <SDL2/SDL.h>
+
+#include "chip8.h"
+#include "config.h"
+#include "emulation.h"
+#include "pixels.h"
+#include "sdlkeys.h"
+#include "utils.h"
+
+typedef struct wall {
+    chip8** chips;
+    chip8clock* clocks;
+    int count;
+    int columns;
+    int rows;
+    int width;
+    int height;
+    // ARGB atlas, one HIRES_X by HIRES_Y tile per instance; lores screens are doubled to fill theirs
+    uint32_t* atlas;
+    // Rows of each tile converted since the last upload, empty when the tile is unchanged
+    SDL_Rect* dirty;
+    // Set when the window needs presenting again even though no tile changed
+    byte redraw;
+    // Whether the renderer hands back the previous pixels when the atlas texture is locked
+    byte lockKeepsPixels;
+} wall;
+
+// Converts the rows of instance i that changed since its last call into its tile
+static void updateTile(wall* w, int i, const uint32_t* palette) {
+    chip8* chip = w->chips[i];
+    uint64_t rows = takeDirtyRows(chip);
+    if (!rows) {
+        return;
+    }
+    int left = (i % w->columns) * HIRES_X;
+    int top = (i / w->columns) * HIRES_Y;
+    uint32_t* tile = w->atlas + top * w->width + left;
+    int pitch = w->width * sizeof(uint32_t);
+    int first = HIRES_Y;
+    int last = 0;
+    for (int y = 0; y < screenHeight(chip); y++) {
+        if (!((rows >> y) & 1)) {
+            continue;
+        }
+        if (chip->hires) {
+            convertRows(&chip->screen, y, y, palette, tile + y * w->width, pitch);
+            first = y < first ? y : first;
+            last = y;
+            continue;
+        }
+        uint32_t line[HIRES_X];
+        convertRows(&chip->screen, y, y, palette, line, sizeof(line));
+        uint32_t* out = tile + 2 * y * w->width;
+        for (int x = 0; x < SCREEN_X; x++) {
+            out[2 * x] = out[2 * x + 1] = line[x];
+        }
+        memcpy(out + w->width, out, HIRES_X * sizeof(uint32_t));
+        first = 2 * y < first ? 2 * y : first;
+        last = 2 * y + 1;
+    }
+    if (first <= last) {
+        w->dirty[i] = (SDL_Rect){ left, top + first, HIRES_X, last - first + 1 };
+    }
+}
+
+// Copies the changed strips of every tile into the streaming texture under one lock per frame, however
+// many tiles changed. Locked pixels are write-only as far as SDL promises: only the OpenGL, OpenGL ES
+// and software renderers lock their own copy of the texture, so elsewhere the whole atlas is copied.
+static void uploadDirty(wall* w, SDL_Texture* texture) {
+    void* locked;
+    int lockedPitch;
+    byte any = 0;
+    for (int i = 0; i < w->count && !any; i++) {
+        any = w->dirty[i].h != 0;
+    }
+    if (!any || SDL_LockTexture(texture, NULL, &locked, &lockedPitch) != 0) {
+        return;
+    }
+    for (int i = 0; i < w->count; i++) {
+        SDL_Rect strip = w->lockKeepsPixels ? w->dirty[i] : (SDL_Rect){ 0, 0, 0, 0 };
+        for (int y = strip.y; y < strip.y + strip.h; y++) {
+            memcpy((byte*)locked + y * lockedPitch + strip.x * sizeof(uint32_t), w->atlas + y * w->width + strip.x,
+                   strip.w * sizeof(uint32_t));
+        }
+        w->dirty[i].h = 0;
+    }
+    if (!w->lockKeepsPixels) {
+        for (int y = 0; y < w->height; y++) {
+            memcpy((byte*)locked + y * lockedPitch, w->atlas + y * w->width, w->width * sizeof(uint32_t));
+        }
+    }
+    SDL_UnlockTexture(texture);
+    w->redraw = 1;
+}
+
+static int processEvents(wall* w) {
+    for (int i = 0; i < w->count; i++) {
+        memset(w->chips[i]->keysNow, 0, sizeof(w->chips[i]->keysNow));
+    }
+    SDL_Event event;
+    while (SDL_PollEvent(&event)) {
+        if (event.type == SDL_QUIT) {
+            return EXIT_SUCCESS;
+        }
+        if (event.type == SDL_WINDOWEVENT) {
+            // Exposed or resized: the last presented frame may be gone
+            w->redraw = 1;
+        }
+        if ((event.type == SDL_KEYDOWN || event.type == SDL_KEYUP) && !event.key.repeat) {
+            byte key = scancodeToKey(event.key.keysym.scancode);
+            if (key >= 0x10) {
+                continue;
+            }
+            for (int i = 0; i < w->count; i++) {
+                w->chips[i]->keys[key] = event.type == SDL_KEYDOWN;
+                if (event.type == SDL_KEYUP) {
+                    w->chips[i]->keysNow[key] = 0x1;
+                }
+            }
+        }
+    }
+    return EXIT_FAILURE;
+}
+
+int main(int argc, char* argv[]) {
+    chip8core core = CORE_SWITCH;
+    byte quirks = DEFAULT_QUIRKS;
+    byte extended = 0;
+    chip8timing timing = TIMING_INSTRUCTIONS;
+    int columns = 0;
+    int copies = 1;
+    uint32_t seed = DEFAULT_SEED;
+    byte reportJitter = 0;
+    unsigned long long ips = DEFAULT_IPS;
+    const char** roms = calloc(argc, sizeof(const char*));
+    int romCount = 0;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--core") == 0 && i + 1 < argc) {
+            core = parseCore(argv[++i]);
+        } else if (strcmp(argv[i], "--quirks") == 0 && i + 1 < argc) {
+            extended = strcmp(argv[i + 1], "xochip") == 0;
+            quirks = parseQuirks(argv[++i]);
+        } else if (strcmp(argv[i], "--timing") == 0 && i + 1 < argc) {
+            timing = parseTiming(argv[++i]);
+        } else if (strcmp(argv[i], "--ips") == 0 && i + 1 < argc) {
+            ips = strtoull(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--columns") == 0 && i + 1 < argc) {
+            columns = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--copies") == 0 && i + 1 < argc) {
+            copies = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+            seed = strtoul(argv[++i], NULL, 0);
+        } else if (strcmp(argv[i], "--jitter") == 0) {
+            reportJitter = 1;
+        } else {
+            roms[romCount++] = argv[i];
+        }
+    }
+    if (romCount == 0 || copies < 1) {
+        fprintf(stderr, "usage: %s [--core name] [--quirks name] [--ips n] [--timing vip] [--columns n] [--copies n] [--seed n] [--jitter] <rom.ch8>...\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    static wall w;
+    w.count = romCount * copies;
+    w.chips = calloc(w.count, sizeof(chip8*));
+    w.clocks = calloc(w.count, sizeof(chip8clock));
+    w.dirty = calloc(w.count, sizeof(SDL_Rect));
+    for (int i = 0; i < w.count; i++) {
+        w.chips[i] = initChip(roms[i % romCount]);
+        if (extended) {
+            setExtendedMemory(w.chips[i], 1);
+        }
+        setQuirks(w.chips[i], quirks);
+        setCore(w.chips[i], core);
+        setTiming(w.chips[i], timing);
+        seedChip(w.chips[i], seed + i);
+        startClock(&w.clocks[i], w.chips[i], ips);
+    }
+    // As square as possible unless asked otherwise
+    w.columns = columns > 0 ? columns : 1;
+    while (columns <= 0 && w.columns * w.columns < w.count) {
+        w.columns++;
+    }
+    w.rows = (w.count + w.columns - 1) / w.columns;
+    w.width = w.columns * HIRES_X;
+    w.height = w.rows * HIRES_Y;
+    w.atlas = calloc((size_t)w.width * w.height, sizeof(uint32_t));
+
+    SDL_Init(SDL_INIT_VIDEO | SDL_INIT_EVENTS);
+    SDL_Window* window = SDL_CreateWindow("CHIP-8 wall", SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED,
+                                          w.width * WALL_TILE_SCALE, w.height * WALL_TILE_SCALE, SDL_WINDOW_ALLOW_HIGHDPI | SDL_WINDOW_RESIZABLE);
+    if (window == NULL) {
+        return 1;
+    }
+    SDL_Renderer* renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_ACCELERATED);
+    SDL_Texture* atlas = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STREAMING, w.width, w.height);
+    SDL_RendererInfo info;
+    if (SDL_GetRendererInfo(renderer, &info) == 0) {
+        w.lockKeepsPixels = strcmp(info.name, "opengl") == 0 || strcmp(info.name, "opengles2") == 0 ||
+                            strcmp(info.name, "software") == 0;
+    }
+    // Streaming textures start out undefined, so the first upload covers the whole atlas
+    SDL_UpdateTexture(atlas, NULL, w.atlas, w.width * sizeof(uint32_t));
+    w.redraw = 1;
+
+    pacer pace;
+    startPacer(&pace, 1000000000LL / FRAMES_PER_SECOND);
+    while (processEvents(&w) != EXIT_SUCCESS) {
+        for (int i = 0; i < w.count; i++) {
+            runClock(&w.clocks[i], w.chips[i], pace.period);
+            updateTile(&w, i, DEFAULT_PALETTE);
+        }
+        uploadDirty(&w, atlas);
+        if (w.redraw) {
+            SDL_RenderClear(renderer);
+            SDL_RenderCopy(renderer, atlas, NULL, NULL);
+            SDL_RenderPresent(renderer);
+            w.redraw = 0;
+        }
+        waitPacer(&pace);
+    }
+
+    if (reportJitter) {
+        printJitter(&pace, "wall", stdout);
+    }
+    for (int i = 0; i < w.count; i++) {
+        destroyChip(w.chips[i]);
+    }
+    free(w.chips);
+    free(w.clocks);
+    free(w.dirty);
+    free(w.atlas);
+    free(roms);
+    SDL_DestroyTexture(atlas);
+    SDL_DestroyRenderer(renderer);
+    SDL_DestroyWindow(window);
+    SDL_Quit();
+    return EXIT_SUCCESS;
+}